@@ -34,11 +34,96 @@ namespace ClientPrediction {
                                                                             TEXT(
                                                                                 "If the client gets this number of ticks away from the desired sim proxy offset a correction is applied"));
 
+    CLIENTPREDICTION_API int32 ClientPredictionSimProxyHistoryTicks = 64;
+    FAutoConsoleVariableRef CVarClientPredictionSimProxyHistoryTicks(TEXT("cp.SimProxyHistoryTicks"), ClientPredictionSimProxyHistoryTicks,
+                                                                     TEXT("The number of server ticks of states that sim proxies keep around for interpolation"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionSimProxyMaxBaselineAge = 32;
+    FAutoConsoleVariableRef CVarClientPredictionSimProxyMaxBaselineAge(TEXT("cp.SimProxyMaxBaselineAge"), ClientPredictionSimProxyMaxBaselineAge,
+                                                                       TEXT(
+                                                                           "Sim proxy states are sent as a keyframe instead of a delta if the baseline is more than this many ticks old. Should be less than cp.SimProxyHistoryTicks"));
+
     CLIENTPREDICTION_API int32 ClientPredictionInputWindowSize = 3;
     FAutoConsoleVariableRef CVarClientPredictionInputWindowSize(TEXT("cp.InputWindowSize"), ClientPredictionInputWindowSize,
-                                                                TEXT("The size of the sliding window used to send inputs"));
+                                                                TEXT("The size of the sliding window used to send inputs, until the authority recommends one"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionAdaptiveInputWindow = 1;
+    FAutoConsoleVariableRef CVarClientPredictionAdaptiveInputWindow(TEXT("cp.AdaptiveInputWindow"), ClientPredictionAdaptiveInputWindow,
+                                                                    TEXT("If non-zero, the authority measures input loss and recommends the size of the input window to the client"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMinInputWindowSize = 2;
+    FAutoConsoleVariableRef CVarClientPredictionMinInputWindowSize(TEXT("cp.MinInputWindowSize"), ClientPredictionMinInputWindowSize,
+                                                                   TEXT("The smallest input window that the authority will recommend, so a single lost bundle can still be recovered"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMaxInputWindowSize = 16;
+    FAutoConsoleVariableRef CVarClientPredictionMaxInputWindowSize(TEXT("cp.MaxInputWindowSize"), ClientPredictionMaxInputWindowSize,
+                                                                   TEXT("The largest input window that the authority will recommend"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputLossInterval = 30;
+    FAutoConsoleVariableRef CVarClientPredictionInputLossInterval(TEXT("cp.InputLossInterval"), ClientPredictionInputLossInterval,
+                                                                  TEXT("The number of input bundles the authority receives before it considers shrinking the input window"));
+
+    CLIENTPREDICTION_API float ClientPredictionInputTargetLoss = 0.001f;
+    FAutoConsoleVariableRef CVarClientPredictionInputTargetLoss(TEXT("cp.InputTargetLoss"), ClientPredictionInputTargetLoss,
+                                                                TEXT("The fraction of input bundles whose inputs may still be lost for good once the input window covers the measured loss"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionAdaptiveInputLead = 1;
+    FAutoConsoleVariableRef CVarClientPredictionAdaptiveInputLead(TEXT("cp.AdaptiveInputLead"), ClientPredictionAdaptiveInputLead,
+                                                                  TEXT("If non-zero, the authority tells clients to move their ticks ahead or back to keep cp.InputBufferTicks of input buffered"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputBufferTicks = 1;
+    FAutoConsoleVariableRef CVarClientPredictionInputBufferTicks(TEXT("cp.InputBufferTicks"), ClientPredictionInputBufferTicks,
+                                                                 TEXT("The fewest ticks of input the authority tries to have buffered ahead of the tick it is simulating"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputBufferSlackTicks = 1;
+    FAutoConsoleVariableRef CVarClientPredictionInputBufferSlackTicks(TEXT("cp.InputBufferSlackTicks"), ClientPredictionInputBufferSlackTicks,
+                                                                      TEXT("How many ticks of input past cp.InputBufferTicks can be buffered before clients are told to move their ticks back"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputBufferInterval = 30;
+    FAutoConsoleVariableRef CVarClientPredictionInputBufferInterval(TEXT("cp.InputBufferInterval"), ClientPredictionInputBufferInterval,
+                                                                    TEXT("The number of ticks the authority measures the input buffer over before telling the client how to adjust"));
+
+    CLIENTPREDICTION_API float ClientPredictionInputLeadStepInterval = 0.5;
+    FAutoConsoleVariableRef CVarClientPredictionInputLeadStepInterval(TEXT("cp.InputLeadStepInterval"), ClientPredictionInputLeadStepInterval,
+                                                                      TEXT("The minimum number of seconds between clients moving their ticks by one, so each step can be measured by the authority"));
 
     CLIENTPREDICTION_API float ClientPredictionSimProxyTickInterval = 0.1;
     FAutoConsoleVariableRef CVarClientPredictionSimProxyTickInterval(TEXT("cp.SimProxyTickInterval"), ClientPredictionSimProxyTickInterval,
                                                                      TEXT("The interval that the authority sends the latest tick to the remotes"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionParallelSimTicks = 0;
+    FAutoConsoleVariableRef CVarClientPredictionParallelSimTicks(TEXT("cp.ParallelSimTicks"), ClientPredictionParallelSimTicks,
+                                                                 TEXT("If non-zero, sims whose traits declare bThreadSafeTick are ticked in parallel on worker threads"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionBundleCodec = 1;
+    FAutoConsoleVariableRef CVarClientPredictionBundleCodec(TEXT("cp.BundleCodec"), ClientPredictionBundleCodec,
+                                                            TEXT("The codec used for input and event bundles. 0 = None, 1 = LZ4, 2 = Oodle, 3 = Zlib"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionDeltaStateBundleCodec = 2;
+    FAutoConsoleVariableRef CVarClientPredictionDeltaStateBundleCodec(TEXT("cp.DeltaStateBundleCodec"), ClientPredictionDeltaStateBundleCodec,
+                                                                      TEXT("The codec used for delta encoded sim proxy state bundles. 0 = None, 1 = LZ4, 2 = Oodle, 3 = Zlib"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionFullStateBundleCodec = 2;
+    FAutoConsoleVariableRef CVarClientPredictionFullStateBundleCodec(TEXT("cp.FullStateBundleCodec"), ClientPredictionFullStateBundleCodec,
+                                                                     TEXT("The codec used for full completeness state bundles. 0 = None, 1 = LZ4, 2 = Oodle, 3 = Zlib"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionBundleCompressionThreshold = 64;
+    FAutoConsoleVariableRef CVarClientPredictionBundleCompressionThreshold(TEXT("cp.BundleCompressionThreshold"), ClientPredictionBundleCompressionThreshold,
+                                                                           TEXT("Bundles smaller than this many bytes are sent uncompressed"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMaxBundleBytes = 1024;
+    FAutoConsoleVariableRef CVarClientPredictionMaxBundleBytes(TEXT("cp.MaxBundleBytes"), ClientPredictionMaxBundleBytes,
+                                                               TEXT("Inputs and events that don't fit in a bundle of this many bytes are split across several bundles"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMaxQueuedEventBytes = 16384;
+    FAutoConsoleVariableRef CVarClientPredictionMaxQueuedEventBytes(TEXT("cp.MaxQueuedEventBytes"), ClientPredictionMaxQueuedEventBytes,
+                                                                    TEXT("Events are held back from a connection while more than this many bytes of them haven't been acked"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMaxHeldEventBytes = 65536;
+    FAutoConsoleVariableRef CVarClientPredictionMaxHeldEventBytes(TEXT("cp.MaxHeldEventBytes"), ClientPredictionMaxHeldEventBytes,
+                                                                  TEXT("The most bytes of events held back for a connection. The oldest are dropped past this"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionUnreliableEventRedundancy = 3;
+    FAutoConsoleVariableRef CVarClientPredictionUnreliableEventRedundancy(TEXT("cp.UnreliableEventRedundancy"), ClientPredictionUnreliableEventRedundancy,
+                                                                          TEXT("The number of consecutive frames that an unreliable event is sent in"));
 }
@@ -0,0 +1,131 @@
+﻿#include "ClientPredictionConnectionManager.h"
+
+#include "Engine/ActorChannel.h"
+#include "Engine/NetConnection.h"
+#include "Net/DataBunch.h"
+
+#include "ClientPrediction.h"
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionV2Component.h"
+
+AClientPredictionConnectionManager::AClientPredictionConnectionManager() {
+    bReplicates = true;
+    bOnlyRelevantToOwner = true;
+
+    PrimaryActorTick.bCanEverTick = false;
+    PrimaryActorTick.bStartWithTickEnabled = false;
+}
+
+void AClientPredictionConnectionManager::SendEventBundles(const TArray<FAggregatedBundle>& Bundles) {
+    for (const FAggregatedBundle& Aggregated : Bundles) {
+        if (IsSimProxyOnConnection(Aggregated)) {
+            HeldEventBundles.Add(Aggregated);
+            HeldEventBytes += Aggregated.Bundle.Bundle().GetNumBytes();
+        }
+    }
+
+    TrimHeldEventBundles();
+
+    // Events are split at cp.MaxBundleBytes so the backlog can be checked between RPCs, and so that one frame can't queue more than one batch past it.
+    while (!HeldEventBundles.IsEmpty() && GetQueuedReliableBytes() <= ClientPrediction::ClientPredictionMaxQueuedEventBytes) {
+        const TArray<FAggregatedBundle> Batch = TakeBatch(HeldEventBundles);
+        for (const FAggregatedBundle& Aggregated : Batch) {
+            HeldEventBytes -= Aggregated.Bundle.Bundle().GetNumBytes();
+        }
+
+        ClientRecvEvents(Batch);
+    }
+}
+
+void AClientPredictionConnectionManager::TrimHeldEventBundles() {
+    HeldEventBundles.RemoveAll([&](const FAggregatedBundle& Aggregated) {
+        if (IsSimProxyOnConnection(Aggregated)) { return false; }
+
+        HeldEventBytes -= Aggregated.Bundle.Bundle().GetNumBytes();
+        return true;
+    });
+
+    // The connection is too far behind for the events to still matter once they arrive, so the oldest are dropped rather than letting the backlog grow.
+    const int32 MaxHeldBytes = FMath::Max(ClientPrediction::ClientPredictionMaxHeldEventBytes, 0);
+
+    int32 NumDropped = 0;
+    while (NumDropped < HeldEventBundles.Num() && HeldEventBytes > MaxHeldBytes) {
+        HeldEventBytes -= HeldEventBundles[NumDropped++].Bundle.Bundle().GetNumBytes();
+    }
+
+    if (NumDropped > 0) {
+        UE_LOG(LogClientPrediction, Warning, TEXT("Dropped %d held event bundles for %s, more than cp.MaxHeldEventBytes were waiting to be sent"), NumDropped,
+               *GetNameSafe(GetNetConnection()));
+        HeldEventBundles.RemoveAt(0, NumDropped);
+    }
+}
+
+void AClientPredictionConnectionManager::SendUnreliableEventBundles(const TArray<FAggregatedBundle>& Bundles) {
+    TArray<FAggregatedBundle> RelevantBundles;
+    for (const FAggregatedBundle& Aggregated : Bundles) {
+        if (IsSimProxyOnConnection(Aggregated)) { RelevantBundles.Add(Aggregated); }
+    }
+
+    // Unreliable RPCs that don't fit in a packet are dropped, so these are split at cp.MaxBundleBytes too.
+    while (!RelevantBundles.IsEmpty()) {
+        ClientRecvUnreliableEvents(TakeBatch(RelevantBundles));
+    }
+}
+
+void AClientPredictionConnectionManager::ClientRecvEvents_Implementation(const TArray<FAggregatedBundle>& Bundles) {
+    RecvEvents(Bundles);
+}
+
+void AClientPredictionConnectionManager::ClientRecvUnreliableEvents_Implementation(const TArray<FAggregatedBundle>& Bundles) {
+    RecvEvents(Bundles);
+}
+
+void AClientPredictionConnectionManager::RecvEvents(const TArray<FAggregatedBundle>& Bundles) {
+    for (const FAggregatedBundle& Aggregated : Bundles) {
+        if (IsValid(Aggregated.Component) && Aggregated.Component->SimCoordinator != nullptr) {
+            Aggregated.Component->SimCoordinator->ConsumeEvents(Aggregated.Bundle);
+        }
+    }
+}
+
+bool AClientPredictionConnectionManager::IsSimProxyOnConnection(const FAggregatedBundle& Aggregated) const {
+    UNetConnection* Connection = GetNetConnection();
+    if (Connection == nullptr || !IsValid(Aggregated.Component)) { return false; }
+
+    AActor* SimActor = Aggregated.Component->GetOwner();
+    return SimActor != nullptr && SimActor->GetNetConnection() != Connection && Connection->FindActorChannelRef(SimActor) != nullptr;
+}
+
+TArray<FAggregatedBundle> AClientPredictionConnectionManager::TakeBatch(TArray<FAggregatedBundle>& Bundles) {
+    const int32 MaxBatchBytes = FMath::Max(ClientPrediction::ClientPredictionMaxBundleBytes, 1);
+
+    int32 NumTaken = 0;
+    int32 BatchBytes = 0;
+
+    for (; NumTaken < Bundles.Num(); ++NumTaken) {
+        const int32 NumBytes = Bundles[NumTaken].Bundle.Bundle().GetNumBytes();
+        if (NumTaken != 0 && BatchBytes + NumBytes > MaxBatchBytes) { break; }
+
+        BatchBytes += NumBytes;
+    }
+
+    TArray<FAggregatedBundle> Batch(Bundles.GetData(), NumTaken);
+    Bundles.RemoveAt(0, NumTaken);
+
+    return Batch;
+}
+
+int32 AClientPredictionConnectionManager::GetQueuedReliableBytes() const {
+    UNetConnection* Connection = GetNetConnection();
+    if (Connection == nullptr) { return 0; }
+
+    const UActorChannel* Channel = Connection->FindActorChannelRef(const_cast<AClientPredictionConnectionManager*>(this));
+    if (Channel == nullptr) { return 0; }
+
+    int32 QueuedBytes = 0;
+    for (const FOutBunch* Bunch = Channel->OutRec; Bunch != nullptr; Bunch = Bunch->Next) {
+        QueuedBytes += Bunch->GetNumBytes();
+    }
+
+    return QueuedBytes;
+}
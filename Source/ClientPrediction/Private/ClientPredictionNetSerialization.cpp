@@ -1,5 +1,11 @@
 ﻿#include "ClientPredictionNetSerialization.h"
 
+#include "Misc/Compression.h"
+
+#include "ClientPrediction.h"
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionPhysState.h"
+
 bool FBundledPackets::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
     return Impl.NetSerialize(Ar, Map, bOutSuccess);
 }
@@ -8,18 +14,337 @@ bool FBundledPackets::Identical(const FBundledPackets* Other, uint32 PortFlags)
     return Impl.Identical(&Other->Impl, PortFlags);
 }
 
-bool FBundledPacketsLow::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+bool FBundledPacketsFull::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
     return Impl.NetSerialize(Ar, Map, bOutSuccess);
 }
 
-bool FBundledPacketsLow::Identical(const FBundledPacketsLow* Other, uint32 PortFlags) const {
+bool FBundledPacketsFull::Identical(const FBundledPacketsFull* Other, uint32 PortFlags) const {
     return Impl.Identical(&Other->Impl, PortFlags);
 }
 
-bool FBundledPacketsFull::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
-    return Impl.NetSerialize(Ar, Map, bOutSuccess);
+namespace ClientPrediction {
+    // Bundles never get anywhere close to this, anything larger is a corrupt or malicious header.
+    static constexpr int32 kMaxDecompressedBundleBytes = 1 << 20;
+
+    void NetSerializeBundleBuffer(FArchive& Ar, FBundleBuffer& Buffer) {
+        int32 NumBytes = Buffer != nullptr ? Buffer->Num() : 0;
+        Ar << NumBytes;
+
+        if (Ar.IsLoading()) {
+            if (NumBytes < 0 || NumBytes > kMaxDecompressedBundleBytes) {
+                Ar.SetError();
+                Buffer = nullptr;
+                return;
+            }
+
+            TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> LoadedBuffer = TSharedObjectPool<TArray<uint8>>::Acquire();
+            LoadedBuffer->SetNumUninitialized(NumBytes);
+            Ar.Serialize(LoadedBuffer->GetData(), NumBytes);
+
+            Buffer = LoadedBuffer;
+        }
+        else if (NumBytes > 0) {
+            // Saving only reads from the buffer.
+            Ar.Serialize(const_cast<uint8*>(Buffer->GetData()), NumBytes);
+        }
+    }
+
+    void NetSerializePacketTick(FArchive& Ar, int32& Tick, TOptional<int32>& PreviousTick) {
+        if (!PreviousTick.IsSet()) {
+            checkSlow(!Ar.IsSaving() || Tick >= INDEX_NONE);
+
+            uint32 PackedTick = static_cast<uint32>(Tick + 1);
+            Ar.SerializeIntPacked(PackedTick);
+
+            Tick = static_cast<int32>(PackedTick) - 1;
+            PreviousTick = Tick;
+            return;
+        }
+
+        uint32 Encoded = 0;
+        if (Ar.IsSaving()) {
+            const int32 Delta = Tick - PreviousTick.GetValue();
+            Encoded = (static_cast<uint32>(Delta) << 1) ^ static_cast<uint32>(Delta >> 31);
+        }
+
+        Ar.SerializeIntPacked(Encoded);
+
+        if (Ar.IsLoading()) {
+            const int32 Delta = static_cast<int32>((Encoded >> 1) ^ (0u - (Encoded & 1u)));
+            Tick = PreviousTick.GetValue() + Delta;
+        }
+
+        PreviousTick = Tick;
+    }
+
+    FName FBundleCodecs::GetFormatName(EBundleCodec Codec) {
+        switch (Codec) {
+        case EBundleCodec::kLZ4:
+            return NAME_LZ4;
+        case EBundleCodec::kOodle:
+            return NAME_Oodle;
+        case EBundleCodec::kZlib:
+            return NAME_Zlib;
+        default:
+            return NAME_None;
+        }
+    }
+
+    static bool CompressWithCodec(EBundleCodec Codec, const TArray<uint8>& Bits, TArray<uint8>& OutCompressed) {
+        const FName Format = FBundleCodecs::GetFormatName(Codec);
+
+        int32 CompressedSize = FCompression::CompressMemoryBound(Format, Bits.Num());
+        OutCompressed.SetNumUninitialized(CompressedSize);
+
+        if (!FCompression::CompressMemory(Format, OutCompressed.GetData(), CompressedSize, Bits.GetData(), Bits.Num())) {
+            OutCompressed.Reset();
+            return false;
+        }
+
+        OutCompressed.SetNum(CompressedSize);
+        return true;
+    }
+
+    static EBundleCodec GetConfiguredCodec(int32 Codec) {
+        if (Codec <= 0 || Codec >= static_cast<int32>(EBundleCodec::kCount)) { return EBundleCodec::kNone; }
+
+        // Oodle isn't available on every platform, zlib always is.
+        if (!FCompression::IsFormatValid(FBundleCodecs::GetFormatName(static_cast<EBundleCodec>(Codec)))) { return EBundleCodec::kZlib; }
+        return static_cast<EBundleCodec>(Codec);
+    }
+
+    EBundleCodec FBundleCodecs::GetCodec(EDataCompleteness Completeness) {
+        return GetConfiguredCodec(Completeness == EDataCompleteness::kFull ? ClientPredictionFullStateBundleCodec : ClientPredictionBundleCodec);
+    }
+
+    EBundleCodec FBundleCodecs::GetDeltaStateCodec() {
+        return GetConfiguredCodec(ClientPredictionDeltaStateBundleCodec);
+    }
+
+    EBundleCodec FBundleCodecs::Compress(EBundleCodec Codec, const TArray<uint8>& Bits, TArray<uint8>& OutCompressed) {
+        if (Codec == EBundleCodec::kNone || Bits.Num() < ClientPredictionBundleCompressionThreshold) { return EBundleCodec::kNone; }
+        if (!CompressWithCodec(Codec, Bits, OutCompressed) || OutCompressed.Num() >= Bits.Num()) { return EBundleCodec::kNone; }
+
+        return Codec;
+    }
+
+    bool FBundleCodecs::Decompress(EBundleCodec Codec, const TArray<uint8>& Compressed, int32 NumBytes, TArray<uint8>& OutBits) {
+        if (NumBytes <= 0 || NumBytes > kMaxDecompressedBundleBytes) { return false; }
+
+        const FName Format = FBundleCodecs::GetFormatName(Codec);
+        if (!FCompression::IsFormatValid(Format)) { return false; }
+
+        OutBits.SetNumUninitialized(NumBytes);
+        return FCompression::UncompressMemory(Format, OutBits.GetData(), NumBytes, Compressed.GetData(), Compressed.Num());
+    }
+
+    static TAtomic<int64> NumCompressions = 0;
+    static TAtomic<int64> NumCompressionCacheHits = 0;
+    static TAtomic<int64> UncompressedBytes = 0;
+    static TAtomic<int64> CompressedBytes = 0;
+
+    static FAutoConsoleCommand CVarClientPredictionBundleCompressionStats(TEXT("cp.BundleCompressionStats"),
+                                                                          TEXT("Logs how many bundle compressions were avoided by the compressed bundle cache and resets the stats"),
+                                                                          FConsoleCommandDelegate::CreateStatic(&FBundleCompressionStats::LogAndReset));
+
+    void FBundleCompressionStats::RecordCompression(int32 NumUncompressedBytes, int32 NumCompressedBytes) {
+        ++NumCompressions;
+        UncompressedBytes += NumUncompressedBytes;
+        CompressedBytes += NumCompressedBytes;
+    }
+
+    void FBundleCompressionStats::RecordCacheHit() {
+        ++NumCompressionCacheHits;
+    }
+
+    void FBundleCompressionStats::LogAndReset() {
+        const int64 Compressions = NumCompressions.Exchange(0);
+        const int64 CacheHits = NumCompressionCacheHits.Exchange(0);
+        const int64 Uncompressed = UncompressedBytes.Exchange(0);
+        const int64 Compressed = CompressedBytes.Exchange(0);
+
+        const int64 Serializations = Compressions + CacheHits;
+        if (Serializations == 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("No bundles have been serialized"));
+            return;
+        }
+
+        UE_LOG(LogClientPrediction, Log, TEXT("%lld bundle serializations, %lld compressions (%.1f%% served from the cache), %lld bytes compressed to %lld"),
+               Serializations, Compressions, 100.0 * CacheHits / Serializations, Uncompressed, Compressed);
+    }
+
+    static TAtomic<int64> NumPoolAllocations = 0;
+    static TAtomic<int64> NumPoolDiscards = 0;
+
+    static FAutoConsoleCommand CVarClientPredictionBundlePoolStats(TEXT("cp.BundlePoolStats"),
+                                                                   TEXT("Logs how many bundle buffers and baselines had to be allocated rather than reused and resets the stats"),
+                                                                   FConsoleCommandDelegate::CreateStatic(&FBundlePoolStats::LogAndReset));
+
+    void FBundlePoolStats::RecordAllocation() {
+        ++NumPoolAllocations;
+    }
+
+    void FBundlePoolStats::RecordDiscard() {
+        ++NumPoolDiscards;
+    }
+
+    void FBundlePoolStats::LogAndReset() {
+        const int64 Allocations = NumPoolAllocations.Exchange(0);
+        const int64 Discards = NumPoolDiscards.Exchange(0);
+
+        UE_LOG(LogClientPrediction, Log, TEXT("%lld bundle objects allocated, %lld deleted because their pool was full"), Allocations, Discards);
+    }
+
+    static TAtomic<int64> StateBits = 0;
+    static TAtomic<int64> NumStatesSent = 0;
+    static TAtomic<int64> NumKeyframesSent = 0;
+
+    static FAutoConsoleCommand CVarClientPredictionStateBandwidthStats(TEXT("cp.StateBandwidthStats"),
+                                                                       TEXT("Logs the average number of bits per delta encoded sim proxy state and resets the stats"),
+                                                                       FConsoleCommandDelegate::CreateStatic(&FStateBandwidthStats::LogAndReset));
+
+    void FStateBandwidthStats::Record(int64 NumBits, int32 NumStates, bool bIsKeyframe) {
+        StateBits += NumBits;
+        NumStatesSent += NumStates;
+        NumKeyframesSent += bIsKeyframe ? NumStates : 0;
+    }
+
+    void FStateBandwidthStats::LogAndReset() {
+        const int64 Bits = StateBits.Exchange(0);
+        const int64 States = NumStatesSent.Exchange(0);
+        const int64 Keyframes = NumKeyframesSent.Exchange(0);
+
+        if (States == 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("No delta encoded states have been sent"));
+            return;
+        }
+
+        UE_LOG(LogClientPrediction, Log, TEXT("%.1f bits per state over %lld states (%.1f%% keyframes)"), static_cast<double>(Bits) / States, States,
+               100.0 * Keyframes / States);
+    }
+
+    /** The per connection state of a delta bundle. */
+    struct FDeltaBundleBaseState : public INetDeltaBaseState {
+        virtual bool IsStateEqual(INetDeltaBaseState* OtherState) override {
+            const FDeltaBundleBaseState* Other = static_cast<FDeltaBundleBaseState*>(OtherState);
+            return Sequence == Other->Sequence && Baseline == Other->Baseline;
+        }
+
+        uint64 Sequence = 0;
+        TSharedPtr<FStateBaseline> Baseline;
+    };
 }
 
-bool FBundledPacketsFull::Identical(const FBundledPacketsFull* Other, uint32 PortFlags) const {
-    return Impl.Identical(&Other->Impl, PortFlags);
+void FBundledPacketsDelta::Copy(const FBundledPacketsDelta& Other) {
+    Encoder = Other.Encoder;
+    Sequence = FMath::Max(Other.Sequence, ++Sequence);
+}
+
+void FBundledPacketsDelta::SetEncoder(const TSharedRef<const ClientPrediction::FDeltaEncoder, ESPMode::ThreadSafe>& NewEncoder) {
+    Encoder = NewEncoder;
+    ++Sequence;
+}
+
+bool FBundledPacketsDelta::Retrieve(TFunctionRef<void(FArchive& Ar)> Decoder) const {
+    using namespace ClientPrediction;
+
+    if (NumberOfBits == INDEX_NONE) { return false; }
+
+    // Like FPacketBundle::Retrieve, the reader reads a scratch buffer in place rather than copying the bits into one of its own.
+    TScopedScratch<TArray<uint8>> Bits;
+
+    const int32 NumBytes = FMath::DivideAndRoundUp(NumberOfBits, 8);
+    if (ReceivedCodec != EBundleCodec::kNone) {
+        if (CompressedBits == nullptr || !FBundleCodecs::Decompress(ReceivedCodec, *CompressedBits, NumBytes, *Bits)) { return false; }
+    }
+    else if (SerializedBits != nullptr && SerializedBits->Num() >= NumBytes) {
+        Bits->Append(SerializedBits->GetData(), NumBytes);
+    }
+
+    if (Bits->Num() < NumBytes) { return false; }
+
+    FScratchBitReader BitReader(*Bits, NumberOfBits);
+    Decoder(BitReader);
+
+    return !BitReader.IsError();
+}
+
+bool FBundledPacketsDelta::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms) {
+    using namespace ClientPrediction;
+
+    if (DeltaParms.Writer != nullptr) {
+        const FDeltaBundleBaseState* OldState = static_cast<FDeltaBundleBaseState*>(DeltaParms.OldState);
+        if (Encoder == nullptr || (OldState != nullptr && OldState->Sequence == Sequence)) { return false; }
+
+        TScopedScratch<FNetBitWriter> Payload;
+        TSharedPtr<FStateBaseline> NewBaseline = Encoder->Encode(*Payload, OldState != nullptr ? OldState->Baseline.Get() : nullptr);
+
+        uint32 PayloadBits = static_cast<uint32>(Payload->GetNumBits());
+        const int32 PayloadBytes = static_cast<int32>(FMath::DivideAndRoundUp(PayloadBits, 8u));
+
+        TScopedScratch<TArray<uint8>> PayloadBuffer;
+        TScopedScratch<TArray<uint8>> Compressed;
+        PayloadBuffer->Append(Payload->GetData(), PayloadBytes);
+
+        const EBundleCodec Codec = FBundleCodecs::Compress(FBundleCodecs::GetDeltaStateCodec(), *PayloadBuffer, *Compressed);
+        FBundleCompressionStats::RecordCompression(PayloadBytes, Codec != EBundleCodec::kNone ? Compressed->Num() : PayloadBytes);
+
+        uint32 CodecValue = static_cast<uint32>(Codec);
+        DeltaParms.Writer->SerializeIntPacked(PayloadBits);
+        DeltaParms.Writer->SerializeInt(CodecValue, static_cast<uint32>(EBundleCodec::kCount));
+
+        if (Codec == EBundleCodec::kNone) {
+            DeltaParms.Writer->SerializeBits(Payload->GetData(), PayloadBits);
+        }
+        else {
+            // The same layout as NetSerializeBundleBuffer, which the receiver reads it with.
+            int32 NumCompressedBytes = Compressed->Num();
+            *DeltaParms.Writer << NumCompressedBytes;
+            DeltaParms.Writer->Serialize(Compressed->GetData(), NumCompressedBytes);
+        }
+
+        if (DeltaParms.NewState != nullptr) {
+            TSharedRef<FDeltaBundleBaseState, ESPMode::ThreadSafe> NewState = TSharedObjectPool<FDeltaBundleBaseState>::Acquire();
+            NewState->Sequence = Sequence;
+            NewState->Baseline = MoveTemp(NewBaseline);
+
+            *DeltaParms.NewState = NewState;
+        }
+
+        return true;
+    }
+
+    if (DeltaParms.Reader != nullptr) {
+        uint32 PayloadBits = 0;
+        uint32 CodecValue = 0;
+        DeltaParms.Reader->SerializeIntPacked(PayloadBits);
+        DeltaParms.Reader->SerializeInt(CodecValue, static_cast<uint32>(EBundleCodec::kCount));
+
+        if (PayloadBits > static_cast<uint32>(kMaxDecompressedBundleBytes) * 8u || CodecValue >= static_cast<uint32>(EBundleCodec::kCount)) {
+            DeltaParms.Reader->SetError();
+            return false;
+        }
+
+        ReceivedCodec = static_cast<EBundleCodec>(CodecValue);
+        if (ReceivedCodec == EBundleCodec::kNone) {
+            TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Payload = TSharedObjectPool<TArray<uint8>>::Acquire();
+            Payload->Reset();
+            Payload->SetNumZeroed(FMath::DivideAndRoundUp(PayloadBits, 8u));
+            DeltaParms.Reader->SerializeBits(Payload->GetData(), PayloadBits);
+
+            SerializedBits = Payload;
+            CompressedBits = nullptr;
+        }
+        else {
+            NetSerializeBundleBuffer(*DeltaParms.Reader, CompressedBits);
+            SerializedBits = nullptr;
+        }
+
+        NumberOfBits = static_cast<int32>(PayloadBits);
+        ++Sequence;
+
+        return !DeltaParms.Reader->IsError();
+    }
+
+    return false;
 }
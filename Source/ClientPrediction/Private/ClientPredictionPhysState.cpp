@@ -3,6 +3,116 @@
 #include "ClientPredictionCVars.h"
 
 namespace ClientPrediction {
+    static uint32 NumBoundedValues(Chaos::FReal Precision, Chaos::FReal Range) {
+        const Chaos::FReal NumValues = 2.0 * Range / Precision + 1.0;
+        return static_cast<uint32>(FMath::Clamp(NumValues, 2.0, static_cast<Chaos::FReal>(TNumericLimits<uint32>::Max())));
+    }
+
+    static uint32 QuantizeBounded(Chaos::FReal Value, Chaos::FReal Precision, Chaos::FReal Range) {
+        const Chaos::FReal Step = FMath::RoundToDouble((FMath::Clamp(Value, -Range, Range) + Range) / Precision);
+        return static_cast<uint32>(FMath::Clamp(Step, 0.0, static_cast<Chaos::FReal>(NumBoundedValues(Precision, Range) - 1)));
+    }
+
+    static Chaos::FReal DequantizeBounded(uint32 Quantized, Chaos::FReal Precision, Chaos::FReal Range) {
+        return Quantized * Precision - Range;
+    }
+
+    static void NetSerializeBounded(FArchive& Ar, Chaos::FVec3& Value, Chaos::FReal Precision, Chaos::FReal Range) {
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            uint32 Quantized = Ar.IsSaving() ? QuantizeBounded(Value[Axis], Precision, Range) : 0;
+            Ar.SerializeInt(Quantized, NumBoundedValues(Precision, Range));
+
+            Value[Axis] = DequantizeBounded(Quantized, Precision, Range);
+        }
+    }
+
+    static void QuantizeBounded(Chaos::FVec3& Value, Chaos::FReal Precision, Chaos::FReal Range) {
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            Value[Axis] = DequantizeBounded(QuantizeBounded(Value[Axis], Precision, Range), Precision, Range);
+        }
+    }
+
+    /** A rotation sent as the index of its largest component and the other three, which are always within +/- 1 / sqrt(2). */
+    struct FSmallestThree {
+        uint32 LargestComponent = 3;
+        uint32 Components[3] = {0, 0, 0};
+
+        static uint32 MaxComponentValue(int32 RotationBits) { return (1u << FMath::Clamp(RotationBits, 2, 30)) - 1u; }
+
+        static FSmallestThree Encode(const Chaos::FRotation3& Rotation, int32 RotationBits) {
+            const Chaos::FRotation3 Normalized = Rotation.GetNormalized();
+            const Chaos::FReal Values[4] = {Normalized.X, Normalized.Y, Normalized.Z, Normalized.W};
+
+            FSmallestThree Encoded{};
+            for (uint32 Component = 0; Component < 4; ++Component) {
+                if (FMath::Abs(Values[Component]) > FMath::Abs(Values[Encoded.LargestComponent])) { Encoded.LargestComponent = Component; }
+            }
+
+            // q and -q are the same rotation, so the largest component is made positive and doesn't need to be sent.
+            const Chaos::FReal Sign = Values[Encoded.LargestComponent] < 0.0 ? -1.0 : 1.0;
+            const Chaos::FReal MaxValue = MaxComponentValue(RotationBits);
+
+            int32 Smallest = 0;
+            for (uint32 Component = 0; Component < 4; ++Component) {
+                if (Component == Encoded.LargestComponent) { continue; }
+
+                const Chaos::FReal Normalized01 = (Values[Component] * Sign * UE_SQRT_2 + 1.0) * 0.5;
+                Encoded.Components[Smallest++] = static_cast<uint32>(FMath::Clamp(FMath::RoundToDouble(Normalized01 * MaxValue), 0.0, MaxValue));
+            }
+
+            return Encoded;
+        }
+
+        Chaos::FRotation3 Decode(int32 RotationBits) const {
+            const Chaos::FReal MaxValue = MaxComponentValue(RotationBits);
+
+            Chaos::FReal Values[4] = {0.0, 0.0, 0.0, 0.0};
+            Chaos::FReal SumSquared = 0.0;
+
+            int32 Smallest = 0;
+            for (uint32 Component = 0; Component < 4; ++Component) {
+                if (Component == LargestComponent) { continue; }
+
+                Values[Component] = (Components[Smallest++] / MaxValue * 2.0 - 1.0) * UE_INV_SQRT_2;
+                SumSquared += Values[Component] * Values[Component];
+            }
+
+            Values[LargestComponent] = FMath::Sqrt(FMath::Max(1.0 - SumSquared, 0.0));
+            return Chaos::FRotation3(Values[0], Values[1], Values[2], Values[3]).GetNormalized();
+        }
+
+        void NetSerialize(FArchive& Ar, int32 RotationBits) {
+            Ar.SerializeInt(LargestComponent, 4);
+            for (uint32& Component : Components) {
+                Ar.SerializeInt(Component, MaxComponentValue(RotationBits) + 1u);
+            }
+        }
+    };
+
+    static void NetSerializeRotation(FArchive& Ar, Chaos::FRotation3& Rotation, int32 RotationBits) {
+        FSmallestThree Encoded = Ar.IsSaving() ? FSmallestThree::Encode(Rotation, RotationBits) : FSmallestThree{};
+        Encoded.NetSerialize(Ar, RotationBits);
+
+        Rotation = Encoded.Decode(RotationBits);
+    }
+
+    const FPhysQuantization& FPhysQuantization::Default() {
+        static const FPhysQuantization kDefault{};
+        return kDefault;
+    }
+
+    void FPhysQuantization::Quantize(FPhysState& State, EDataCompleteness Completeness) const {
+        if (Completeness == EDataCompleteness::kFull && !bQuantizeFullStates) { return; }
+
+        QuantizeBounded(State.X, PositionPrecision, PositionRange);
+        State.R = FSmallestThree::Encode(State.R, RotationBits).Decode(RotationBits);
+
+        if (Completeness == EDataCompleteness::kFull && bQuantizeVelocities) {
+            QuantizeBounded(State.V, VelocityPrecision, VelocityRange);
+            QuantizeBounded(State.W, AngularVelocityPrecision, AngularVelocityRange);
+        }
+    }
+
     bool FPhysState::ShouldReconcile(const FPhysState& State) const {
         if (State.ObjectState != ObjectState) { return true; }
         if ((State.X - X).Size() > ClientPredictionPositionTolerance)
@@ -33,6 +143,12 @@ namespace ClientPrediction {
         W = FMath::Lerp(FVector(W), FVector(Other.W), Alpha);
     }
 
+    void FPhysState::InterpolateTransform(const FPhysState& Start, const FPhysState& End, Chaos::FReal Alpha) {
+        ObjectState = End.ObjectState;
+        X = FMath::Lerp(FVector(Start.X), FVector(End.X), Alpha);
+        R = FMath::Lerp(FQuat(Start.R), FQuat(End.R), Alpha);
+    }
+
     void FPhysState::Extrapolate(const FPhysState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime) {
         const Chaos::FVec3 Velocity = (X - PrevState.X) / StateDt;
         const Chaos::FVec3 AngularVelocity = Chaos::FRotation3::CalculateAngularVelocity(PrevState.R, R, StateDt);
@@ -42,17 +158,40 @@ namespace ClientPrediction {
     }
 
     void FPhysState::NetSerialize(FArchive& Ar, EDataCompleteness Completeness) {
-        if (Completeness == EDataCompleteness::kLow) {
-            SerializePackedVector<100, 30>(X, Ar);
+        NetSerialize(Ar, Completeness, FPhysQuantization::Default());
+    }
 
-            bool bOutSuccess = false;
-            R.NetSerialize(Ar, nullptr, bOutSuccess);
+    void FPhysState::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, const FPhysQuantization& Quantization) {
+        if (Completeness == EDataCompleteness::kLow) {
+            NetSerializeBounded(Ar, X, Quantization.PositionPrecision, Quantization.PositionRange);
+            NetSerializeRotation(Ar, R, Quantization.RotationBits);
 
             return;
         }
 
         Ar << ObjectState;
 
+        if (Quantization.bQuantizeFullStates) {
+            NetSerializeBounded(Ar, X, Quantization.PositionPrecision, Quantization.PositionRange);
+            NetSerializeRotation(Ar, R, Quantization.RotationBits);
+
+            if (Quantization.bQuantizeVelocities) {
+                NetSerializeBounded(Ar, V, Quantization.VelocityPrecision, Quantization.VelocityRange);
+                NetSerializeBounded(Ar, W, Quantization.AngularVelocityPrecision, Quantization.AngularVelocityRange);
+            }
+            else {
+                Ar << V.X;
+                Ar << V.Y;
+                Ar << V.Z;
+
+                Ar << W.X;
+                Ar << W.Y;
+                Ar << W.Z;
+            }
+
+            return;
+        }
+
         // Serialize manually to make sure that they are serialized as doubles
         Ar << X.X;
         Ar << X.Y;
@@ -71,4 +210,99 @@ namespace ClientPrediction {
         Ar << W.Y;
         Ar << W.Z;
     }
+
+    /** The smallest three components are within +/- 1 / sqrt(2), which is scaled to +/- half of the RotationBits range. */
+    static Chaos::FReal GetRotationScale(const FPhysQuantization& Quantization) {
+        return static_cast<Chaos::FReal>(FSmallestThree::MaxComponentValue(Quantization.RotationBits)) * 0.5 * UE_SQRT_2;
+    }
+
+    FQuantizedPhysState FQuantizedPhysState::Quantize(const FPhysState& State, const FPhysQuantization& Quantization) {
+        const Chaos::FReal PositionScale = 1.0 / Quantization.PositionPrecision;
+        const Chaos::FReal RotationScale = GetRotationScale(Quantization);
+
+        FQuantizedPhysState Quantized{};
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            const Chaos::FReal Scaled = FMath::Clamp(State.X[Axis] * PositionScale, static_cast<Chaos::FReal>(TNumericLimits<int32>::Min()),
+                                                     static_cast<Chaos::FReal>(TNumericLimits<int32>::Max()));
+            Quantized.X[Axis] = static_cast<int32>(FMath::RoundToDouble(Scaled));
+        }
+
+        const Chaos::FRotation3 Normalized = State.R.GetNormalized();
+        const Chaos::FReal Values[4] = {Normalized.X, Normalized.Y, Normalized.Z, Normalized.W};
+
+        for (uint32 Component = 0; Component < 4; ++Component) {
+            if (FMath::Abs(Values[Component]) > FMath::Abs(Values[Quantized.LargestComponent])) { Quantized.LargestComponent = Component; }
+        }
+
+        // q and -q are the same rotation, so the largest component is made positive and doesn't need to be sent.
+        const Chaos::FReal Sign = Values[Quantized.LargestComponent] < 0.0 ? -1.0 : 1.0;
+        const Chaos::FReal MaxValue = FMath::FloorToDouble(RotationScale * UE_INV_SQRT_2);
+
+        int32 Smallest = 0;
+        for (uint32 Component = 0; Component < 4; ++Component) {
+            if (Component == Quantized.LargestComponent) { continue; }
+
+            const Chaos::FReal Scaled = FMath::Clamp(FMath::RoundToDouble(Values[Component] * Sign * RotationScale), -MaxValue, MaxValue);
+            Quantized.R[Smallest++] = static_cast<int32>(Scaled);
+        }
+
+        return Quantized;
+    }
+
+    void FQuantizedPhysState::Dequantize(FPhysState& State, const FPhysQuantization& Quantization) const {
+        const Chaos::FReal RotationScale = GetRotationScale(Quantization);
+
+        State.X = Chaos::FVec3(X[0], X[1], X[2]) * Quantization.PositionPrecision;
+
+        Chaos::FReal Values[4] = {0.0, 0.0, 0.0, 0.0};
+        Chaos::FReal SumSquared = 0.0;
+
+        int32 Smallest = 0;
+        for (uint32 Component = 0; Component < 4; ++Component) {
+            if (Component == LargestComponent) { continue; }
+
+            Values[Component] = R[Smallest++] / RotationScale;
+            SumSquared += Values[Component] * Values[Component];
+        }
+
+        Values[LargestComponent] = FMath::Sqrt(FMath::Max(1.0 - SumSquared, 0.0));
+        State.R = Chaos::FRotation3(Values[0], Values[1], Values[2], Values[3]).GetNormalized();
+    }
+
+    static void NetSerializeComponentDelta(FArchive& Ar, int32& Value, int32 Baseline) {
+        // The difference is zigzag encoded so small negative deltas stay small. Wrapping arithmetic keeps this exact even if the difference overflows.
+        uint32 Encoded = 0;
+        if (Ar.IsSaving()) {
+            const int32 Delta = static_cast<int32>(static_cast<uint32>(Value) - static_cast<uint32>(Baseline));
+            Encoded = (static_cast<uint32>(Delta) << 1) ^ static_cast<uint32>(Delta >> 31);
+        }
+
+        Ar.SerializeIntPacked(Encoded);
+
+        if (Ar.IsLoading()) {
+            const uint32 Delta = (Encoded >> 1) ^ (0u - (Encoded & 1u));
+            Value = static_cast<int32>(static_cast<uint32>(Baseline) + Delta);
+        }
+    }
+
+    void FQuantizedPhysState::NetSerializeDelta(FArchive& Ar, const FQuantizedPhysState& Baseline) {
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            NetSerializeComponentDelta(Ar, X[Axis], Baseline.X[Axis]);
+        }
+
+        // The largest component rarely changes between states, so it only takes a bit unless it does.
+        uint8 bSameLargest = Ar.IsSaving() && LargestComponent == Baseline.LargestComponent ? 1 : 0;
+        Ar.SerializeBits(&bSameLargest, 1);
+
+        if (bSameLargest != 0) {
+            LargestComponent = Baseline.LargestComponent;
+        }
+        else {
+            Ar.SerializeInt(LargestComponent, 4);
+        }
+
+        for (int32 Component = 0; Component < 3; ++Component) {
+            NetSerializeComponentDelta(Ar, R[Component], Baseline.R[Component]);
+        }
+    }
 }
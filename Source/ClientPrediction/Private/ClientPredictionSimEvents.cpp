@@ -1,56 +1,79 @@
 ﻿#include "ClientPredictionSimEvents.h"
 
 namespace ClientPrediction {
+    void USimEvents::SetBufferSize(int32 NewBufferSize) {
+        FScopeLock EventLock(&EventMutex);
+
+        BufferSize = NewBufferSize;
+        RegisteredFactories.ForEach([&](EventId Id) { Factories[Id]->SetBufferSize(BufferSize); });
+    }
+
     void USimEvents::ConsumeEvents(const FBundledPackets& Packets, Chaos::FReal SimDt) {
-        TArray<FEventLoader> AuthorityEvents;
-        Packets.Bundle().Retrieve(AuthorityEvents, FEventLoaderUserdata{Factories, SimDt});
+        FScopeLock EventLock(&EventMutex);
+
+        TScopedScratch<TArray<FEventLoader>> AuthorityEvents;
+        Packets.Bundle().Retrieve(*AuthorityEvents, FEventLoaderUserdata{Factories, ActiveFactories, SimDt});
     }
 
-    void USimEvents::ConsumeRemoteSimProxyOffset(const FRemoteSimProxyOffset& Offset) {
-        QueuedRemoteSimProxyOffsets.Enqueue(Offset);
+    void USimEvents::SetRemoteSimProxyOffsets(const TSharedPtr<FRemoteSimProxyOffsets>& NewRemoteSimProxyOffsets) {
+        FScopeLock EventLock(&EventMutex);
+        RemoteSimProxyOffsets = NewRemoteSimProxyOffsets;
     }
 
     void USimEvents::PreparePrePhysics(const FNetTickInfo& TickInfo) {
         FScopeLock EventLock(&EventMutex);
 
-        // These are emitted over a reliable RPC, so the order is guaranteed. No need to keep track of which offset has been acked.
-        FRemoteSimProxyOffset NewRemoteSimProxyOffset{};
-        while (QueuedRemoteSimProxyOffsets.Peek(NewRemoteSimProxyOffset)) {
-            if (NewRemoteSimProxyOffset.ExpectedAppliedServerTick <= TickInfo.ServerTick) {
-                RemoteSimProxyOffset = NewRemoteSimProxyOffset.ServerTickOffset;
-                QueuedRemoteSimProxyOffsets.Pop();
+        // These are sent over a reliable RPC, so every offset arrives. No need to keep track of which offset has been acked.
+        if (RemoteSimProxyOffsets != nullptr) {
+            if (const TOptional<int32> NewRemoteSimProxyOffset = RemoteSimProxyOffsets->GetOffsetForTick(TickInfo.ServerTick)) {
+                RemoteSimProxyOffset = NewRemoteSimProxyOffset.GetValue();
             }
-            else { break; }
         }
     }
 
     void USimEvents::ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole) {
         FScopeLock EventLock(&EventMutex);
-        for (auto& FactoryPair : Factories) {
-            FactoryPair.Value->ExecuteEvents(ResultsTime, SimProxyOffset, SimRole, HistoryDuration);
-        }
+        ActiveFactories.ForEach([&](EventId Id) {
+            Factories[Id]->ExecuteEvents(ResultsTime, SimProxyOffset, SimRole, HistoryDuration);
+            if (!Factories[Id]->HasEvents()) { ActiveFactories.Remove(Id); }
+        });
     }
 
     void USimEvents::Rewind(int32 LocalRewindTick) {
         FScopeLock EventLock(&EventMutex);
-        for (auto& FactoryPair : Factories) {
-            FactoryPair.Value->Rewind(LocalRewindTick);
-        }
+        ActiveFactories.ForEach([&](EventId Id) { Factories[Id]->Rewind(LocalRewindTick); });
     }
 
     void USimEvents::EmitEvents() {
         FScopeLock EventLock(&EventMutex);
 
-        TArray<FEventSaver> Serializers;
+        TScopedScratch<TArray<FEventSaver>> Serializers;
+        TScopedScratch<TArray<FEventSaver>> UnreliableSerializers;
         const int32 CurrentLatestEmittedTick = LatestEmittedTick;
 
-        for (auto& FactoryPair : Factories) {
-            const int32 FactoryNewestEvent = FactoryPair.Value->EmitEvents(CurrentLatestEmittedTick, Serializers);
+        EmittingFactories.ForEach([&](EventId Id) {
+            FEventFactoryBase& Factory = *Factories[Id];
+            TArray<FEventSaver>& FactorySerializers = Factory.GetDelivery() == EEventDelivery::kUnreliable ? *UnreliableSerializers : *Serializers;
+
+            const int32 FactoryNewestEvent = Factory.EmitEvents(CurrentLatestEmittedTick, FactorySerializers);
             LatestEmittedTick = FMath::Max(FactoryNewestEvent, LatestEmittedTick);
-        }
 
-        FBundledPackets EventPackets{};
-        EventPackets.Bundle().Store(Serializers, this);
-        EmitEventBundle.ExecuteIfBound(EventPackets);
+            if (!Factory.HasEventsToEmit()) { EmittingFactories.Remove(Id); }
+        });
+
+        EmitBundles(*Serializers, EmitEventBundle);
+        EmitBundles(*UnreliableSerializers, EmitUnreliableEventBundle);
+    }
+
+    void USimEvents::EmitBundles(TArray<FEventSaver>& Serializers, const FEmitEventBundleDelegate& Delegate) {
+        // Most ticks don't have any events, and an empty bundle would still cost an RPC.
+        if (Serializers.IsEmpty()) { return; }
+
+        FBundledPackets::BundleType::StoreChunked(Serializers, this, [&](const FBundledPackets::BundleType& Bundle) {
+            FBundledPackets EventPackets{};
+            EventPackets.Bundle() = Bundle;
+
+            Delegate.ExecuteIfBound(EventPackets);
+        });
     }
 }
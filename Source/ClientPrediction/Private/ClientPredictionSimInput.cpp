@@ -0,0 +1,182 @@
+﻿#include "ClientPredictionSimInput.h"
+
+#include "ClientPrediction.h"
+
+namespace ClientPrediction {
+    /** A window of one can't recover any lost bundle, so even without loss the window stays at cp.MinInputWindowSize. */
+    static int32 ClampWindowSize(int32 WindowSize) {
+        const int32 MinWindowSize = FMath::Max(ClientPredictionMinInputWindowSize, 1);
+        return FMath::Clamp(WindowSize, MinWindowSize, FMath::Max(ClientPredictionMaxInputWindowSize, MinWindowSize));
+    }
+
+    /** The number of bundles that have to be lost in a row before an input is lost for good, at least one so that a single lost bundle is recovered. */
+    static int32 GetSpareBundles(double LossRate) {
+        const double TargetLoss = FMath::Clamp(static_cast<double>(ClientPredictionInputTargetLoss), UE_DOUBLE_SMALL_NUMBER, 1.0 - UE_DOUBLE_SMALL_NUMBER);
+        if (LossRate <= TargetLoss) { return 1; }
+        if (LossRate >= 1.0) { return ClientPredictionMaxInputWindowSize; }
+
+        // Losing SpareBundles + 1 bundles in a row happens with a probability of LossRate ^ (SpareBundles + 1).
+        return FMath::Max(FMath::CeilToInt(FMath::Loge(TargetLoss) / FMath::Loge(LossRate)) - 1, 1);
+    }
+
+    void FInputLossTracker::RecordBundle(int32 OldestTick, int32 NewestTick) {
+        // Bundles that arrive out of order only carry inputs that were already received.
+        if (NewestTick <= LatestReceivedTick) { return; }
+
+        if (LatestReceivedTick == INDEX_NONE) {
+            LatestReceivedTick = NewestTick;
+            return;
+        }
+
+        // Every tick after the newest one that was received has to be in this bundle, otherwise it's lost for good.
+        const int32 Gap = NewestTick - LatestReceivedTick;
+        NumUnrecoveredTicks += FMath::Max(OldestTick - LatestReceivedTick - 1, 0);
+        LatestReceivedTick = NewestTick;
+
+        // The smallest gap is the number of ticks a client sends per bundle when nothing is lost, so larger gaps are made up of lost bundles.
+        ++NumBundles;
+        MinGap = FMath::Min(MinGap, Gap);
+        MaxGap = FMath::Max(MaxGap, Gap);
+        NumLostBundles += FMath::Max(FMath::RoundToInt(static_cast<float>(Gap) / MinGap) - 1, 0);
+
+        // A gap the window didn't cover means inputs were lost for good, so it grows right away and leaves a bundle to spare.
+        const int32 WindowSize = RecommendedWindowSize;
+        if (Gap > WindowSize) {
+            RecommendedWindowSize = ClampWindowSize(Gap + MinGap);
+        }
+
+        if (NumBundles < ClientPredictionInputLossInterval) { return; }
+
+        const double LossRate = static_cast<double>(NumLostBundles) / (NumBundles + NumLostBundles);
+        const int32 NeededWindowSize = MinGap * (1 + GetSpareBundles(LossRate));
+
+        const int32 CurrentWindowSize = RecommendedWindowSize;
+        if (CurrentWindowSize < NeededWindowSize) {
+            RecommendedWindowSize = ClampWindowSize(NeededWindowSize);
+        }
+        else if (CurrentWindowSize > FMath::Max(NeededWindowSize, MaxGap)) {
+            RecommendedWindowSize = ClampWindowSize(CurrentWindowSize - 1);
+        }
+
+        FInputRedundancyStats::RecordInterval(NumBundles, NumLostBundles, NumUnrecoveredTicks, RecommendedWindowSize);
+
+        NumBundles = 0;
+        NumLostBundles = 0;
+        NumUnrecoveredTicks = 0;
+        MinGap = TNumericLimits<int32>::Max();
+        MaxGap = 0;
+    }
+
+    void FInputLossTracker::RecordStarvedTick() {
+        FInputRedundancyStats::RecordStarvedTick();
+    }
+
+    void FInputBufferTracker::RecordTick(int32 BufferedTicks) {
+        MinBufferedTicks = FMath::Min(MinBufferedTicks, BufferedTicks);
+        if (++NumTicks < ClientPredictionInputBufferInterval) { return; }
+
+        // Positive adjustments move the client's ticks further ahead, so its inputs arrive earlier.
+        const int32 MinTicks = ClientPredictionInputBufferTicks;
+        const int32 MaxTicks = MinTicks + FMath::Max(ClientPredictionInputBufferSlackTicks, 0);
+
+        int32 AdjustmentTicks = 0;
+        if (MinBufferedTicks < MinTicks) { AdjustmentTicks = MinTicks - MinBufferedTicks; }
+        else if (MinBufferedTicks > MaxTicks) { AdjustmentTicks = MaxTicks - MinBufferedTicks; }
+
+        AdjustmentTicks = FMath::Clamp(AdjustmentTicks, static_cast<int32>(TNumericLimits<int8>::Min()), static_cast<int32>(TNumericLimits<int8>::Max()));
+        FInputRedundancyStats::RecordBufferedTicks(MinBufferedTicks, AdjustmentTicks);
+
+        {
+            FScopeLock AdjustmentLock(&AdjustmentMutex);
+            Adjustment.Ticks = static_cast<int8>(AdjustmentTicks);
+            ++Adjustment.Sequence;
+        }
+
+        NumTicks = 0;
+        MinBufferedTicks = TNumericLimits<int32>::Max();
+    }
+
+    FInputLeadAdjustment FInputBufferTracker::GetAdjustment() const {
+        FScopeLock AdjustmentLock(&AdjustmentMutex);
+        return Adjustment;
+    }
+
+    void USimInputBase::SetSendWindowSize(int32 WindowSize) {
+        FScopeLock SendLock(&SendMutex);
+        SendWindowSize = ClampWindowSize(WindowSize);
+    }
+
+    static TAtomic<int64> NumBundlesReceived = 0;
+    static TAtomic<int64> NumBundlesLost = 0;
+    static TAtomic<int64> NumTicksUnrecovered = 0;
+    static TAtomic<int64> NumTicksStarved = 0;
+    static TAtomic<int64> RecommendedWindowSizes = 0;
+    static TAtomic<int64> NumIntervals = 0;
+    static TAtomic<int64> BufferedTicks = 0;
+    static TAtomic<int64> LeadAdjustments = 0;
+    static TAtomic<int64> NumBufferIntervals = 0;
+    static TAtomic<int64> SentWindowSizes = 0;
+    static TAtomic<int64> NumWindowsSent = 0;
+
+    static FAutoConsoleCommand CVarClientPredictionInputRedundancyStats(TEXT("cp.InputRedundancyStats"),
+                                                                        TEXT("Logs the measured input loss, starvation and input window sizes and resets the stats"),
+                                                                        FConsoleCommandDelegate::CreateStatic(&FInputRedundancyStats::LogAndReset));
+
+    void FInputRedundancyStats::RecordInterval(int32 NumBundles, int32 NumLostBundles, int32 NumUnrecoveredTicks, int32 RecommendedWindowSize) {
+        NumBundlesReceived += NumBundles;
+        NumBundlesLost += NumLostBundles;
+        NumTicksUnrecovered += NumUnrecoveredTicks;
+        RecommendedWindowSizes += RecommendedWindowSize;
+        ++NumIntervals;
+    }
+
+    void FInputRedundancyStats::RecordBufferedTicks(int32 MinBufferedTicks, int32 LeadAdjustment) {
+        BufferedTicks += MinBufferedTicks;
+        LeadAdjustments += LeadAdjustment != 0 ? 1 : 0;
+        ++NumBufferIntervals;
+    }
+
+    void FInputRedundancyStats::RecordStarvedTick() {
+        ++NumTicksStarved;
+    }
+
+    void FInputRedundancyStats::RecordSentWindow(int32 WindowSize) {
+        SentWindowSizes += WindowSize;
+        ++NumWindowsSent;
+    }
+
+    void FInputRedundancyStats::LogAndReset() {
+        const int64 Received = NumBundlesReceived.Exchange(0);
+        const int64 Lost = NumBundlesLost.Exchange(0);
+        const int64 Unrecovered = NumTicksUnrecovered.Exchange(0);
+        const int64 Starved = NumTicksStarved.Exchange(0);
+        const int64 Recommended = RecommendedWindowSizes.Exchange(0);
+        const int64 Intervals = NumIntervals.Exchange(0);
+        const int64 Buffered = BufferedTicks.Exchange(0);
+        const int64 Adjustments = LeadAdjustments.Exchange(0);
+        const int64 BufferIntervals = NumBufferIntervals.Exchange(0);
+        const int64 Sent = SentWindowSizes.Exchange(0);
+        const int64 WindowsSent = NumWindowsSent.Exchange(0);
+
+        if (Intervals != 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("%.1f%% input bundles lost, %lld ticks lost despite redundancy, %lld starved ticks, %.1f inputs recommended per bundle"),
+                   100.0 * Lost / FMath::Max<int64>(Received + Lost, 1), Unrecovered, Starved, static_cast<double>(Recommended) / Intervals);
+        }
+        else if (Starved != 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("%lld starved ticks"), Starved);
+        }
+
+        if (BufferIntervals != 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("%.1f ticks of input buffered at the least, %.1f%% of measurements asked the client to move its ticks"),
+                   static_cast<double>(Buffered) / BufferIntervals, 100.0 * Adjustments / BufferIntervals);
+        }
+
+        if (WindowsSent != 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("%.1f inputs sent per bundle over %lld bundles"), static_cast<double>(Sent) / WindowsSent, WindowsSent);
+        }
+
+        if (Intervals == 0 && Starved == 0 && BufferIntervals == 0 && WindowsSent == 0) {
+            UE_LOG(LogClientPrediction, Log, TEXT("No inputs have been sent or received"));
+        }
+    }
+}
@@ -1,10 +1,35 @@
 ﻿#include "ClientPredictionSimProxy.h"
 
+#include "Algo/BinarySearch.h"
+#include "GameFramework/PlayerController.h"
 #include "Net/UnrealNetwork.h"
 
 #include "ClientPrediction.h"
 #include "ClientPredictionCVars.h"
+#include "ClientPredictionConnectionManager.h"
 #include "ClientPredictionUtils.h"
+#include "ClientPredictionV2Component.h"
+
+namespace ClientPrediction {
+    void FRemoteSimProxyOffsets::Add(const FRemoteSimProxyOffset& Offset) {
+        FScopeLock Lock(&OffsetsMutex);
+
+        // Offsets can be carried by different components, which don't guarantee their order relative to each other.
+        const int32 InsertIndex = Algo::UpperBoundBy(Offsets, Offset.ExpectedAppliedServerTick, &FRemoteSimProxyOffset::ExpectedAppliedServerTick);
+        Offsets.Insert(Offset, InsertIndex);
+    }
+
+    TOptional<int32> FRemoteSimProxyOffsets::GetOffsetForTick(int32 ServerTick) {
+        FScopeLock Lock(&OffsetsMutex);
+
+        const int32 NumApplicable = Algo::UpperBoundBy(Offsets, ServerTick, &FRemoteSimProxyOffset::ExpectedAppliedServerTick);
+        if (NumApplicable == 0) { return {}; }
+
+        // The newest applicable offset is kept for the other sims of the connection.
+        Offsets.RemoveAt(0, NumApplicable - 1);
+        return Offsets[0].ServerTickOffset;
+    }
+}
 
 TMap<UWorld*, AClientPredictionSimProxyManager*> AClientPredictionSimProxyManager::Managers;
 
@@ -21,6 +46,7 @@ void AClientPredictionSimProxyManager::InitializeWorld(UWorld* World) {
     AClientPredictionSimProxyManager* Manager = World->SpawnActor<AClientPredictionSimProxyManager>(SpawnParameters);
     check(Manager);
 
+    Manager->Scheduler = MakeUnique<ClientPrediction::FSimScheduler>(World, Manager);
     Managers.Add(World, Manager);
 }
 
@@ -31,6 +57,8 @@ AClientPredictionSimProxyManager* AClientPredictionSimProxyManager::ManagerForWo
 
 void AClientPredictionSimProxyManager::CleanupWorld(const UWorld* World) {
     if (!Managers.Contains(World)) { return; }
+
+    Managers[World]->Scheduler = nullptr;
     Managers.Remove(World);
 }
 
@@ -65,6 +93,30 @@ void AClientPredictionSimProxyManager::Tick(float DeltaSeconds) {
     if (PhysSolver == nullptr) { return; }
 
     LatestServerTick = PhysSolver->GetCurrentFrame();
+    UpdateConnectionManagers();
+}
+
+void AClientPredictionSimProxyManager::UpdateConnectionManagers() {
+    for (auto It = ConnectionManagers.CreateIterator(); It; ++It) {
+        const APlayerController* PlayerController = It->Key.Get();
+        AClientPredictionConnectionManager* ConnectionManager = It->Value.Get();
+        if (PlayerController != nullptr && PlayerController->GetNetConnection() != nullptr && ConnectionManager != nullptr) { continue; }
+
+        if (ConnectionManager != nullptr) { ConnectionManager->Destroy(); }
+        It.RemoveCurrent();
+    }
+
+    for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It) {
+        APlayerController* PlayerController = It->Get();
+        if (PlayerController == nullptr || PlayerController->IsLocalController() || PlayerController->GetNetConnection() == nullptr) { continue; }
+        if (ConnectionManagers.Contains(PlayerController)) { continue; }
+
+        FActorSpawnParameters SpawnParameters{};
+        SpawnParameters.Owner = PlayerController;
+        SpawnParameters.ObjectFlags |= EObjectFlags::RF_Transient;
+
+        ConnectionManagers.Add(PlayerController, GetWorld()->SpawnActor<AClientPredictionConnectionManager>(SpawnParameters));
+    }
 }
 
 int32 AClientPredictionSimProxyManager::GetLocalToServerOffset() const {
@@ -77,6 +129,151 @@ const TOptional<FRemoteSimProxyOffset>& AClientPredictionSimProxyManager::GetRem
     return RemoteSimProxyOffset;
 }
 
+void AClientPredictionSimProxyManager::RegisterAutonomousComponent(UClientPredictionV2Component* Component) {
+    // The authority keeps the offset for the whole connection, so it only needs to be resent when there was nothing to carry it before.
+    if (AutonomousComponents.IsEmpty()) {
+        FScopeLock OffsetsLock(&OffsetsMutex);
+        bRemoteSimProxyOffsetDirty = RemoteSimProxyOffset.IsSet();
+    }
+
+    AutonomousComponents.AddUnique(Component);
+}
+
+void AClientPredictionSimProxyManager::UnregisterAutonomousComponent(UClientPredictionV2Component* Component) {
+    AutonomousComponents.Remove(Component);
+}
+
+void AClientPredictionSimProxyManager::FlushRemoteSimProxyOffset() {
+    AutonomousComponents.RemoveAll([](const TWeakObjectPtr<UClientPredictionV2Component>& Component) { return !Component.IsValid(); });
+
+    const TWeakObjectPtr<UClientPredictionV2Component>* Sender = AutonomousComponents.FindByPredicate(
+        [](const TWeakObjectPtr<UClientPredictionV2Component>& Component) { return Component->ShouldSendToServer(); });
+    if (Sender == nullptr) { return; }
+
+    // The flag is cleared together with taking the offset, so an update from the physics thread after this is sent on the next flush instead of being lost.
+    FRemoteSimProxyOffset Offset{};
+    {
+        FScopeLock OffsetsLock(&OffsetsMutex);
+        if (!bRemoteSimProxyOffsetDirty || !RemoteSimProxyOffset.IsSet()) { return; }
+
+        Offset = RemoteSimProxyOffset.GetValue();
+        bRemoteSimProxyOffsetDirty = false;
+    }
+
+    (*Sender)->ServerRecvRemoteSimProxyOffset(Offset);
+}
+
+void AClientPredictionSimProxyManager::ConsumeRemoteSimProxyOffset(const UNetConnection* Connection, const FRemoteSimProxyOffset& Offset) {
+    if (TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets> Offsets = GetRemoteSimProxyOffsets(Connection)) {
+        Offsets->Add(Offset);
+    }
+}
+
+TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets> AClientPredictionSimProxyManager::GetRemoteSimProxyOffsets(const UNetConnection* Connection) {
+    if (Connection == nullptr) { return nullptr; }
+
+    if (const TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets>* Offsets = ConnectionRemoteSimProxyOffsets.Find(Connection)) {
+        return *Offsets;
+    }
+
+    // Connections that closed are only cleaned up when a new one shows up, since that's the only time the map grows.
+    for (auto It = ConnectionRemoteSimProxyOffsets.CreateIterator(); It; ++It) {
+        if (!It.Key().IsValid()) { It.RemoveCurrent(); }
+    }
+
+    TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets> Offsets = MakeShared<ClientPrediction::FRemoteSimProxyOffsets>();
+    ConnectionRemoteSimProxyOffsets.Add(Connection, Offsets);
+
+    return Offsets;
+}
+
+int32 AClientPredictionSimProxyManager::GetInputLeadOffset() const {
+    FScopeLock OffsetsLock(&OffsetsMutex);
+    return InputLeadOffset;
+}
+
+void AClientPredictionSimProxyManager::AdjustInputLead(const FInputLeadAdjustment& Adjustment) {
+    if (Adjustment.Ticks == 0) { return; }
+
+    // The authority needs time to see the previous step before its measurements mean anything, so steps are spread out.
+    const double Now = FPlatformTime::Seconds();
+    if (LastInputLeadStepTime >= 0.0 && Now - LastInputLeadStepTime < ClientPrediction::ClientPredictionInputLeadStepInterval) { return; }
+    LastInputLeadStepTime = Now;
+
+    FScopeLock OffsetsLock(&OffsetsMutex);
+    InputLeadOffset += FMath::Sign(static_cast<int32>(Adjustment.Ticks));
+
+    UE_LOG(LogClientPrediction, Log, TEXT("Updating input lead offset to %d"), InputLeadOffset);
+}
+
+void AClientPredictionSimProxyManager::QueueInputBundle(UClientPredictionV2Component* Component, const FBundledPackets& Bundle) {
+    FAggregatedBundle& Aggregated = PendingInputBundles.AddDefaulted_GetRef();
+    Aggregated.Component = Component;
+    Aggregated.Bundle.Bundle().Copy(Bundle.Bundle());
+}
+
+void AClientPredictionSimProxyManager::FlushInputBundles() {
+    if (PendingInputBundles.IsEmpty()) { return; }
+
+    // Every sim on the client is owned by the same connection, so any of them can carry the inputs of the others. Batches are still split at
+    // cp.MaxBundleBytes so a frame with a backlog of inputs doesn't become one oversized unreliable bunch.
+    const int32 MaxBatchBytes = FMath::Max(ClientPrediction::ClientPredictionMaxBundleBytes, 1);
+
+    TArray<FAggregatedBundle> Batch;
+    int32 BatchBytes = 0;
+
+    auto SendBatch = [&]() {
+        if (Batch.IsEmpty()) { return; }
+
+        for (const FAggregatedBundle& Aggregated : Batch) {
+            if (IsValid(Aggregated.Component)) {
+                Aggregated.Component->ServerRecvInputs(Batch);
+                break;
+            }
+        }
+
+        Batch.Reset();
+        BatchBytes = 0;
+    };
+
+    for (FAggregatedBundle& Aggregated : PendingInputBundles) {
+        const int32 NumBytes = Aggregated.Bundle.Bundle().GetNumBytes();
+        if (!Batch.IsEmpty() && BatchBytes + NumBytes > MaxBatchBytes) { SendBatch(); }
+
+        Batch.Add(MoveTemp(Aggregated));
+        BatchBytes += NumBytes;
+    }
+
+    SendBatch();
+    PendingInputBundles.Reset();
+}
+
+void AClientPredictionSimProxyManager::QueueEventBundle(UClientPredictionV2Component* Component, const FBundledPackets& Bundle) {
+    FAggregatedBundle& Aggregated = PendingEventBundles.AddDefaulted_GetRef();
+    Aggregated.Component = Component;
+    Aggregated.Bundle.Bundle().Copy(Bundle.Bundle());
+}
+
+void AClientPredictionSimProxyManager::QueueUnreliableEventBundle(UClientPredictionV2Component* Component, const FBundledPackets& Bundle) {
+    FAggregatedBundle& Aggregated = PendingUnreliableEventBundles.AddDefaulted_GetRef();
+    Aggregated.Component = Component;
+    Aggregated.Bundle.Bundle().Copy(Bundle.Bundle());
+}
+
+void AClientPredictionSimProxyManager::FlushEventBundles() {
+    // Connections with a backlog hold on to their events, so this still runs when nothing new was emitted.
+    for (const auto& Pair : ConnectionManagers) {
+        AClientPredictionConnectionManager* ConnectionManager = Pair.Value.Get();
+        if (ConnectionManager == nullptr) { continue; }
+
+        ConnectionManager->SendEventBundles(PendingEventBundles);
+        ConnectionManager->SendUnreliableEventBundles(PendingUnreliableEventBundles);
+    }
+
+    PendingEventBundles.Reset();
+    PendingUnreliableEventBundles.Reset();
+}
+
 void AClientPredictionSimProxyManager::LatestServerTickChangedGT() {
     if (!HasActorBegunPlay()) { return; }
 
@@ -119,12 +316,13 @@ void AClientPredictionSimProxyManager::LatestServerTickChangedPT(int32 TickToPro
         UE_LOG(LogClientPrediction, Log, TEXT("Updating sim proxy offset to %d. "), NewLocalOffset);
     }
 
-    // This offset can be added to a server tick on the authority to get the tick for sim proxies that is being displayed
-    const int32 AuthorityServerOffset = TickInfo.LocalTick + LocalToServerOffset - TickInfo.ServerTick;
+    // This offset can be added to a server tick on the authority to get the tick for sim proxies that is being displayed. The server ticks of autonomous
+    // proxies include the input lead offset, so it's taken into account here too.
+    const int32 AuthorityServerOffset = TickInfo.LocalTick + LocalToServerOffset - (TickInfo.ServerTick + InputLeadOffset);
     if (!RemoteSimProxyOffset.IsSet() || RemoteSimProxyOffset.GetValue().ServerTickOffset != AuthorityServerOffset) {
         RemoteSimProxyOffset = {TickInfo.ServerTick, AuthorityServerOffset};
 
         UE_LOG(LogClientPrediction, Log, TEXT("Updating remote sim proxy offset %d"), AuthorityServerOffset);
-        RemoteSimProxyOffsetChangedDelegate.Broadcast(RemoteSimProxyOffset);
+        bRemoteSimProxyOffsetDirty = true;
     }
 }
@@ -0,0 +1,150 @@
+﻿#include "ClientPredictionSimScheduler.h"
+
+#include "Physics/NetworkPhysicsComponent.h"
+
+#include "ClientPredictionSimCoordinator.h"
+#include "ClientPredictionSimProxy.h"
+#include "ClientPredictionUtils.h"
+
+namespace ClientPrediction {
+    int32 FSimGroupIds::AllocateId() {
+        static int32 NextGroupId = 0;
+        return NextGroupId++;
+    }
+
+    FSimScheduler::FSimScheduler(UWorld* World, AClientPredictionSimProxyManager* SimProxyWorldManager) :
+        Chaos::ISimCallbackObject(Chaos::ESimCallbackOptions::Rewind), World(World), SimProxyWorldManager(SimProxyWorldManager) {}
+
+    FSimScheduler::~FSimScheduler() {
+        UnregisterCallbacks();
+    }
+
+    bool FSimScheduler::BuildTickContext(FWorldTickContext& Context) const {
+        if (SimProxyWorldManager == nullptr || !FUtils::FillWorldTickContext(Context, World)) { return false; }
+
+        Context.SimProxyWorldManager = SimProxyWorldManager;
+        Context.InputLeadOffset = SimProxyWorldManager->GetInputLeadOffset();
+        return true;
+    }
+
+    void FSimScheduler::RegisterCallbacks() {
+        if (bRegisteredCallbacks) { return; }
+
+        FPhysScene* PhysScene = FUtils::GetPhysScene(World);
+        if (PhysScene == nullptr) { return; }
+
+        Chaos::FPhysicsSolver* PhysSolver = PhysScene->GetSolver();
+        if (PhysSolver == nullptr) { return; }
+
+        FNetworkPhysicsCallback* PhysCallback = static_cast<FNetworkPhysicsCallback*>(PhysSolver->GetRewindCallback());
+        if (PhysCallback == nullptr) { return; }
+
+        InjectInputsGTDelegateHandle = PhysCallback->InjectInputsExternal.AddRaw(this, &FSimScheduler::InjectInputsGT);
+        PreAdvanceDelegateHandle = PhysCallback->PreProcessInputsInternal.AddRaw(this, &FSimScheduler::PreAdvance);
+        PostAdvanceDelegateHandle = PhysSolver->AddPostAdvanceCallback(FSolverPostAdvance::FDelegate::CreateRaw(this, &FSimScheduler::PostAdvance));
+        PhysScenePostTickDelegateHandle = PhysScene->OnPhysScenePostTick.AddRaw(this, &FSimScheduler::OnPhysScenePostTick);
+
+        PhysCallback->RegisterRewindableSimCallback_Internal(this);
+        bRegisteredCallbacks = true;
+    }
+
+    void FSimScheduler::UnregisterCallbacks() {
+        if (!bRegisteredCallbacks) { return; }
+        bRegisteredCallbacks = false;
+
+        FPhysScene* PhysScene = FUtils::GetPhysScene(World);
+        if (PhysScene == nullptr) { return; }
+
+        PhysScene->OnPhysScenePostTick.Remove(PhysScenePostTickDelegateHandle);
+
+        Chaos::FPhysicsSolver* PhysSolver = PhysScene->GetSolver();
+        if (PhysSolver == nullptr) { return; }
+
+        PhysSolver->RemovePostAdvanceCallback(PostAdvanceDelegateHandle);
+
+        FNetworkPhysicsCallback* PhysCallback = static_cast<FNetworkPhysicsCallback*>(PhysSolver->GetRewindCallback());
+        if (PhysCallback == nullptr) { return; }
+
+        PhysCallback->InjectInputsExternal.Remove(InjectInputsGTDelegateHandle);
+        PhysCallback->PreProcessInputsInternal.Remove(PreAdvanceDelegateHandle);
+        PhysCallback->UnregisterRewindableSimCallback_Internal(this);
+    }
+
+    void FSimScheduler::Retire(TUniquePtr<USimCoordinatorBase> Coordinator) {
+        check(IsInGameThread());
+
+        // Changes are applied in order, so by the time this runs the physics thread has already removed the coordinator from its groups.
+        QueueChangePT([Retired = MoveTemp(Coordinator)]() {});
+    }
+
+    void FSimScheduler::QueueChangePT(TUniqueFunction<void()>&& Change) {
+        FScopeLock ChangesLock(&ChangesMutex);
+        PendingChangesPT.Add(MoveTemp(Change));
+    }
+
+    void FSimScheduler::ApplyChangesPT() {
+        TArray<TUniqueFunction<void()>> Changes;
+        {
+            FScopeLock ChangesLock(&ChangesMutex);
+            if (PendingChangesPT.IsEmpty()) { return; }
+
+            Changes = MoveTemp(PendingChangesPT);
+        }
+
+        for (TUniqueFunction<void()>& Change : Changes) {
+            Change();
+        }
+    }
+
+    int32 FSimScheduler::TriggerRewindIfNeeded_Internal(int32 LastCompletedTick) {
+        ApplyChangesPT();
+
+        FWorldTickContext Context{};
+        if (!BuildTickContext(Context)) { return INDEX_NONE; }
+
+        int32 RewindTick = INDEX_NONE;
+        ForEachGroup(GroupsPT, [&](FSimGroupBase& Group) {
+            const int32 GroupRewindTick = Group.TriggerRewindIfNeeded(Context);
+            if (GroupRewindTick == INDEX_NONE) { return; }
+
+            RewindTick = RewindTick == INDEX_NONE ? GroupRewindTick : FMath::Min(RewindTick, GroupRewindTick);
+        });
+
+        return RewindTick;
+    }
+
+    void FSimScheduler::InjectInputsGT(const int32 StartTick, const int32 NumTicks) {
+        ForEachGroup(Groups, [](FSimGroupBase& Group) { Group.InjectInputsGT(); });
+    }
+
+    void FSimScheduler::PreAdvance(const int32 TickNum) {
+        ApplyChangesPT();
+
+        FWorldTickContext Context{};
+        if (!BuildTickContext(Context)) { return; }
+
+        ForEachGroup(GroupsPT, [&](FSimGroupBase& Group) { Group.PreAdvance(TickNum, Context); });
+    }
+
+    void FSimScheduler::PostAdvance(Chaos::FReal Dt) {
+        ApplyChangesPT();
+
+        FWorldTickContext Context{};
+        if (!BuildTickContext(Context)) { return; }
+
+        ForEachGroup(GroupsPT, [&](FSimGroupBase& Group) { Group.PostAdvance(Context); });
+    }
+
+    void FSimScheduler::OnPhysScenePostTick(FChaosScene* Scene) {
+        FWorldTickContext Context{};
+        if (!BuildTickContext(Context)) { return; }
+
+        ForEachGroup(Groups, [&](FSimGroupBase& Group) { Group.PostTickGT(Context); });
+
+        // Sims on clients queue their inputs with the manager while they are ticked, so they are all sent together. The remote sim proxy offset is
+        // changed on the physics thread, so it's also sent from here.
+        SimProxyWorldManager->FlushInputBundles();
+        SimProxyWorldManager->FlushRemoteSimProxyOffset();
+        SimProxyWorldManager->FlushEventBundles();
+    }
+}
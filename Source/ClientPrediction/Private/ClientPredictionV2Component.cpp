@@ -15,6 +15,8 @@ UClientPredictionV2Component::~UClientPredictionV2Component() {}
 void UClientPredictionV2Component::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const {
     Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
+    DOREPLIFETIME_CONDITION(UClientPredictionV2Component, InputWindowSize, COND_AutonomousOnly);
+    DOREPLIFETIME_CONDITION(UClientPredictionV2Component, InputLeadAdjustment, COND_AutonomousOnly);
     DOREPLIFETIME_CONDITION(UClientPredictionV2Component, SimProxyStates, COND_SimulatedOnly);
     DOREPLIFETIME_CONDITION(UClientPredictionV2Component, AutoProxyStates, COND_AutonomousOnly);
     DOREPLIFETIME(UClientPredictionV2Component, FinalState);
@@ -35,6 +37,11 @@ void UClientPredictionV2Component::BeginPlay() {
 
     SimCoordinator->Initialize(UpdatedComponent, OwnerActor->GetLocalRole());
 
+    AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
+    if (Manager != nullptr && OwnerActor->GetLocalRole() == ROLE_AutonomousProxy) {
+        Manager->RegisterAutonomousComponent(this);
+    }
+
     if (FinalState.HasData()) {
         SimCoordinator->ConsumeFinalState(FinalState);
     }
@@ -51,9 +58,16 @@ void UClientPredictionV2Component::UninitializeComponent() {
 }
 
 void UClientPredictionV2Component::DestroySimulation() {
+    AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
+    if (Manager != nullptr) {
+        Manager->UnregisterAutonomousComponent(this);
+    }
+
     if (SimCoordinator != nullptr) {
         SimCoordinator->Destroy();
 
+        // The physics thread might still be ticking the coordinator, so the scheduler deletes it once the physics thread has dropped it.
+        if (Manager != nullptr) { Manager->GetScheduler().Retire(MoveTemp(SimCoordinator)); }
         SimCoordinator = nullptr;
         SimInput = nullptr;
         SimState = nullptr;
@@ -61,8 +75,40 @@ void UClientPredictionV2Component::DestroySimulation() {
     }
 }
 
-void UClientPredictionV2Component::ServerRecvInput_Implementation(const FBundledPackets& Bundle) {
-    if (SimCoordinator != nullptr) { SimCoordinator->ConsumeInputBundle(Bundle); }
+void UClientPredictionV2Component::ServerRecvInputs_Implementation(const TArray<FAggregatedBundle>& Bundles) {
+    const AActor* OwnerActor = GetOwner();
+    if (OwnerActor == nullptr || OwnerActor->GetNetConnection() == nullptr) { return; }
+
+    FPhysScene* PhysScene = ClientPrediction::FUtils::GetPhysScene(GetWorld());
+    if (PhysScene == nullptr) { return; }
+
+    // Clients can only send inputs for sims owned by their own connection. The inputs are resolved here on the game thread, since DestroySimulation can
+    // reset the component's sim at any time. Holding a reference keeps the input alive until the physics thread has consumed the bundle.
+    TArray<TPair<TSharedPtr<ClientPrediction::USimInputBase>, FBundledPackets>> Inputs;
+    for (const FAggregatedBundle& Aggregated : Bundles) {
+        const UClientPredictionV2Component* Component = Aggregated.Component;
+        if (!IsValid(Component) || Component->GetOwner() == nullptr || Component->GetOwner()->GetNetConnection() != OwnerActor->GetNetConnection()) {
+            continue;
+        }
+
+        if (Component->SimInput != nullptr) { Inputs.Emplace(Component->SimInput, Aggregated.Bundle); }
+    }
+
+    if (Inputs.IsEmpty()) { return; }
+
+    PhysScene->EnqueueAsyncPhysicsCommand(0, nullptr, [Inputs = MoveTemp(Inputs)]() {
+        for (const auto& Input : Inputs) {
+            Input.Key->ConsumeInputBundle(Input.Value);
+        }
+    });
+}
+
+void UClientPredictionV2Component::OnRep_InputWindowSize() {
+    if (SimCoordinator != nullptr && InputWindowSize != 0) { SimCoordinator->ConsumeInputWindowSize(InputWindowSize); }
+}
+
+void UClientPredictionV2Component::OnRep_InputLeadAdjustment() {
+    if (SimCoordinator != nullptr) { SimCoordinator->ConsumeInputLeadAdjustment(InputLeadAdjustment); }
 }
 
 void UClientPredictionV2Component::OnRep_SimProxyStates() {
@@ -77,12 +123,9 @@ void UClientPredictionV2Component::OnRep_FinalState() {
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeFinalState(FinalState); }
 }
 
-void UClientPredictionV2Component::ClientRecvEvents_Implementation(const FBundledPackets& Bundle) {
-    if (SimCoordinator != nullptr) { SimCoordinator->ConsumeEvents(Bundle); }
-}
-
 void UClientPredictionV2Component::ServerRecvRemoteSimProxyOffset_Implementation(const FRemoteSimProxyOffset& Offset) {
-    if (SimCoordinator != nullptr) { SimCoordinator->ConsumeRemoteSimProxyOffset(Offset); }
+    AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
+    if (Manager != nullptr && GetOwner() != nullptr) { Manager->ConsumeRemoteSimProxyOffset(GetOwner()->GetNetConnection(), Offset); }
 }
 
 bool UClientPredictionV2Component::ShouldSendToServer() const {
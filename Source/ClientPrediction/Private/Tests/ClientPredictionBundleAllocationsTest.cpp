@@ -0,0 +1,132 @@
+﻿#include "Misc/AutomationTest.h"
+#include "HAL/MemoryBase.h"
+
+#include "ClientPredictionNetSerialization.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ClientPrediction {
+    /**
+     * Forwards to the engine's allocator and counts the allocations made by the thread that is counting. Other threads allocate through it too while it's
+     * installed, which is fine since everything ends up in the same allocator.
+     */
+    class FCountingMalloc : public FMalloc {
+    public:
+        void Begin() {
+            CountingThreadId = FPlatformTLS::GetCurrentThreadId();
+            NumAllocations = 0;
+            Inner = GMalloc;
+            GMalloc = this;
+        }
+
+        int32 End() {
+            GMalloc = Inner;
+            CountingThreadId = 0;
+            return NumAllocations;
+        }
+
+        virtual void* Malloc(SIZE_T Count, uint32 Alignment) override {
+            RecordAllocation();
+            return Inner->Malloc(Count, Alignment);
+        }
+
+        virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override {
+            RecordAllocation();
+            return Inner->Realloc(Original, Count, Alignment);
+        }
+
+        virtual void Free(void* Original) override { Inner->Free(Original); }
+        virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+        virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+        virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+        virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+        virtual const TCHAR* GetDescriptiveName() override { return TEXT("ClientPredictionCountingMalloc"); }
+
+    private:
+        void RecordAllocation() {
+            if (FPlatformTLS::GetCurrentThreadId() == CountingThreadId) { ++NumAllocations; }
+        }
+
+        FMalloc* Inner = nullptr;
+        TAtomic<uint32> CountingThreadId = 0;
+        int32 NumAllocations = 0;
+    };
+
+    struct FPoolTestPacket {
+        int32 ServerTick = INDEX_NONE;
+        FVector Location = FVector::ZeroVector;
+
+        void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, const void* Userdata) { Ar << Location; }
+        bool operator==(const FPoolTestPacket& Other) const { return ServerTick == Other.ServerTick && Location == Other.Location; }
+    };
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionBundleAllocationsTest, "ClientPrediction.NetSerialization.SteadyStateAllocations",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionBundleAllocationsTest::RunTest(const FString& Parameters) {
+    using namespace ClientPrediction;
+
+    // Codecs allocate their own working memory, so the bundle path is measured uncompressed.
+    TGuardValue<int32> CodecGuard(ClientPredictionFullStateBundleCodec, 0);
+
+    TArray<FPoolTestPacket> Packets;
+    for (int32 PacketIdx = 0; PacketIdx < 16; ++PacketIdx) {
+        Packets.Add({1000 + PacketIdx, FVector(10.0 * PacketIdx, 5.0, 1.0)});
+    }
+
+    TArray<FPoolTestPacket> Decoded;
+    Decoded.Reserve(Packets.Num());
+
+    FNetBitWriter Writer(nullptr, TNumericLimits<uint16>::Max());
+    Writer.SetAllowResize(true);
+
+    FBundledPacketsFull Sent{};
+    FBundledPacketsFull Received{};
+    bool bSuccess = false;
+
+    Sent.Bundle().Store(Packets, nullptr);
+    Sent.NetSerialize(Writer, nullptr, bSuccess);
+
+    // Every iteration reads the same bits, so the reader is created once and rewound.
+    FNetBitReader Reader(nullptr, Writer.GetData(), Writer.GetNumBits());
+
+    // Emits a bundle, copies it the way it's copied into a replicated property, serializes it to a connection, receives it and retrieves the packets.
+    auto EmitAndConsume = [&]() {
+        Sent.Bundle().Store(Packets, nullptr);
+        FBundledPacketsFull Replicated = Sent;
+
+        Writer.Reset();
+        Replicated.NetSerialize(Writer, nullptr, bSuccess);
+
+        FBitReaderMark Mark(Reader);
+        Received.NetSerialize(Reader, nullptr, bSuccess);
+        Mark.Pop(Reader);
+
+        Decoded.Reset();
+        return Received.Bundle().Retrieve(Decoded, nullptr);
+    };
+
+    // The pools and scratch objects grow to what a bundle needs on the first few iterations.
+    for (int32 Iteration = 0; Iteration < 4; ++Iteration) {
+        EmitAndConsume();
+    }
+
+    static FCountingMalloc CountingMalloc;
+    CountingMalloc.Begin();
+
+    bool bRetrieved = true;
+    for (int32 Iteration = 0; Iteration < 100; ++Iteration) {
+        bRetrieved &= EmitAndConsume();
+    }
+
+    const int32 NumAllocations = CountingMalloc.End();
+
+    TestTrue(TEXT("Every bundle is retrieved"), bRetrieved);
+    TestTrue(TEXT("The retrieved packets match the stored ones"), Decoded == Packets);
+    TestEqual(TEXT("Emitting and consuming bundles doesn't allocate once the pools have warmed up"), NumAllocations, 0);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+﻿#include "Misc/AutomationTest.h"
+#include "Misc/Compression.h"
+
+#include "ClientPredictionNetSerialization.h"
+#include "ClientPredictionPhysState.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ClientPrediction {
+    static constexpr int32 kBenchmarkIterations = 1000;
+    static constexpr int32 kBenchmarkSendInterval = 2;
+
+    /**
+     * A fixed bundle of phys states that looks like the ones a body moving along a curve sends. Either a chain of delta encoded sim proxy states, the way
+     * FBundledPacketsDelta sends them, or full auto proxy states.
+     */
+    static TArray<uint8> MakeBenchmarkPayload(int32 NumStates, bool bDelta) {
+        FNetBitWriter Writer(nullptr, TNumericLimits<uint16>::Max());
+        Writer.SetAllowResize(true);
+
+        FQuantizedPhysState Baseline{};
+        for (int32 StateIdx = 0; StateIdx < NumStates; ++StateIdx) {
+            const Chaos::FReal Time = StateIdx / 30.0;
+
+            FPhysState State{};
+            State.ObjectState = Chaos::EObjectStateType::Dynamic;
+            State.X = Chaos::FVec3(1200.0 * Time, 300.0 * FMath::Sin(Time), 15.0);
+            State.V = Chaos::FVec3(1200.0, 300.0 * FMath::Cos(Time), 0.0);
+            State.R = Chaos::FRotation3(FVector::UpVector, 0.5 * Time);
+            State.W = Chaos::FVec3(0.0, 0.0, 0.5);
+
+            const uint32 ServerTick = 1000 + StateIdx * kBenchmarkSendInterval;
+            if (bDelta) {
+                uint32 PackedTick = StateIdx == 0 ? ServerTick : kBenchmarkSendInterval;
+                Writer.SerializeIntPacked(PackedTick);
+
+                FQuantizedPhysState Quantized = FQuantizedPhysState::Quantize(State, FPhysQuantization::Default());
+                Quantized.NetSerializeDelta(Writer, Baseline);
+                Baseline = Quantized;
+            }
+            else {
+                uint32 PackedTick = ServerTick;
+                Writer.SerializeIntPacked(PackedTick);
+                State.NetSerialize(Writer, EDataCompleteness::kFull);
+            }
+        }
+
+        return TArray<uint8>(Writer.GetData(), static_cast<int32>(Writer.GetNumBytes()));
+    }
+
+    /** Compresses and decompresses the payload with every available codec, checks that it survives and reports the size and time of each. */
+    static void BenchmarkCodecs(FAutomationTestBase& Test, const TCHAR* PayloadName, const TArray<uint8>& Bits) {
+        Test.AddInfo(FString::Printf(TEXT("%s: %d bytes uncompressed"), PayloadName, Bits.Num()));
+
+        for (uint8 CodecValue = static_cast<uint8>(EBundleCodec::kLZ4); CodecValue < static_cast<uint8>(EBundleCodec::kCount); ++CodecValue) {
+            const EBundleCodec Codec = static_cast<EBundleCodec>(CodecValue);
+            const FName Format = FBundleCodecs::GetFormatName(Codec);
+            if (!FCompression::IsFormatValid(Format)) { continue; }
+
+            TArray<uint8> Compressed;
+            TArray<uint8> Decompressed;
+
+            // Compression isn't skipped for small or incompressible payloads here, so every codec is measured on the same input.
+            int32 CompressedSize = 0;
+            const uint64 EncodeStart = FPlatformTime::Cycles64();
+            for (int32 Iteration = 0; Iteration < kBenchmarkIterations; ++Iteration) {
+                CompressedSize = FCompression::CompressMemoryBound(Format, Bits.Num());
+                Compressed.SetNumUninitialized(CompressedSize, EAllowShrinking::No);
+                FCompression::CompressMemory(Format, Compressed.GetData(), CompressedSize, Bits.GetData(), Bits.Num());
+            }
+
+            Compressed.SetNum(CompressedSize, EAllowShrinking::No);
+
+            bool bDecompressed = true;
+            const uint64 DecodeStart = FPlatformTime::Cycles64();
+            for (int32 Iteration = 0; Iteration < kBenchmarkIterations; ++Iteration) {
+                bDecompressed &= FBundleCodecs::Decompress(Codec, Compressed, Bits.Num(), Decompressed);
+            }
+
+            const uint64 DecodeEnd = FPlatformTime::Cycles64();
+            const double EncodeNs = FPlatformTime::ToMilliseconds64(DecodeStart - EncodeStart) * 1e6 / kBenchmarkIterations;
+            const double DecodeNs = FPlatformTime::ToMilliseconds64(DecodeEnd - DecodeStart) * 1e6 / kBenchmarkIterations;
+
+            Test.TestTrue(FString::Printf(TEXT("%s decompresses with %s"), PayloadName, *Format.ToString()), bDecompressed && Decompressed == Bits);
+            Test.AddInfo(FString::Printf(TEXT("  %-6s %4d bytes (ratio %.2f), encode %8.0f ns, decode %8.0f ns"), *Format.ToString(), Compressed.Num(),
+                                         static_cast<double>(Bits.Num()) / FMath::Max(Compressed.Num(), 1), EncodeNs, DecodeNs));
+        }
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionBundleCodecsTest, "ClientPrediction.NetSerialization.BundleCodecs",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FClientPredictionBundleCodecsTest::RunTest(const FString& Parameters) {
+    using namespace ClientPrediction;
+
+    for (const int32 NumStates : {4, 16, 64}) {
+        BenchmarkCodecs(*this, *FString::Printf(TEXT("%d delta sim proxy states"), NumStates), MakeBenchmarkPayload(NumStates, true));
+        BenchmarkCodecs(*this, *FString::Printf(TEXT("%d full states"), NumStates), MakeBenchmarkPayload(NumStates, false));
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,43 @@
+﻿#include "Misc/AutomationTest.h"
+
+#include "ClientPredictionSimInput.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ClientPrediction {
+    /** Sends TicksPerBundle ticks per bundle for NumBundles bundles, dropping every LossPeriod-th one, and returns the window the tracker settled on. */
+    static int32 SettleInputWindow(int32 TicksPerBundle, int32 LossPeriod, int32 NumBundles) {
+        FInputLossTracker Tracker;
+
+        int32 NewestTick = 0;
+        for (int32 BundleIdx = 1; BundleIdx <= NumBundles; ++BundleIdx) {
+            NewestTick += TicksPerBundle;
+            if (LossPeriod > 0 && BundleIdx % LossPeriod == 0) { continue; }
+
+            const int32 WindowSize = FMath::Max(Tracker.GetRecommendedWindowSize(), TicksPerBundle);
+            Tracker.RecordBundle(NewestTick - WindowSize + 1, NewestTick);
+        }
+
+        return Tracker.GetRecommendedWindowSize();
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionInputLossTrackerTest, "ClientPrediction.SimInput.LossTracker",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionInputLossTrackerTest::RunTest(const FString& Parameters) {
+    using namespace ClientPrediction;
+
+    TGuardValue<int32> MinWindowGuard(ClientPredictionMinInputWindowSize, 2);
+    TGuardValue<int32> MaxWindowGuard(ClientPredictionMaxInputWindowSize, 16);
+    TGuardValue<int32> IntervalGuard(ClientPredictionInputLossInterval, 30);
+    TGuardValue<float> TargetLossGuard(ClientPredictionInputTargetLoss, 0.001f);
+
+    TestEqual(TEXT("Without loss the window keeps one bundle to spare"), SettleInputWindow(2, 0, 600), 4);
+    TestEqual(TEXT("At 9% loss the window keeps two bundles to spare"), SettleInputWindow(2, 11, 660), 6);
+    TestEqual(TEXT("At 33% loss the window keeps six bundles to spare"), SettleInputWindow(1, 3, 600), 7);
+
+    return true;
+}
+
+#endif
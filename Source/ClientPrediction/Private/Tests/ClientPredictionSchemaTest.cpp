@@ -0,0 +1,43 @@
+﻿#include "Misc/AutomationTest.h"
+
+#include "ClientPredictionSchema.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace ClientPrediction {
+    struct FSchemaTestState {
+        double Speed = 0.0;
+        FVector Velocity = FVector::ZeroVector;
+
+        static constexpr auto kSchema = MakeSchema(Field(&FSchemaTestState::Speed).WithRange(-2000.0, 2000.0).WithPrecision(0.1),
+                                                   Field(&FSchemaTestState::Velocity).WithRange(-2000.0, 2000.0).WithPrecision(0.1));
+    };
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionSchemaReconcileTest, "ClientPrediction.Schema.QuantizedReconcile",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionSchemaReconcileTest::RunTest(const FString& Parameters) {
+    using namespace ClientPrediction;
+
+    FSchemaTestState Predicted{};
+    Predicted.Speed = 123.4567;
+    Predicted.Velocity = FVector(10.0123, -20.0456, 30.0789);
+
+    // What the authority sends is the same state, quantized to the precision of each field.
+    const auto SpeedField = Field(&FSchemaTestState::Speed).WithRange(-2000.0, 2000.0).WithPrecision(0.1);
+    FSchemaTestState Authority{};
+    Authority.Speed = SpeedField.SentValue(Predicted.Speed);
+    Authority.Velocity = FVector(SpeedField.SentValue(Predicted.Velocity.X), SpeedField.SentValue(Predicted.Velocity.Y),
+                                 SpeedField.SentValue(Predicted.Velocity.Z));
+
+    TestFalse(TEXT("A correct prediction isn't reconciled against its quantized authority state"),
+              FSchemaTestState::kSchema.ShouldReconcile(Predicted, Authority));
+
+    Authority.Speed += 0.5;
+    TestTrue(TEXT("A misprediction larger than the precision is reconciled"), FSchemaTestState::kSchema.ShouldReconcile(Predicted, Authority));
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,92 @@
+﻿#include "Misc/AutomationTest.h"
+#include "Async/Async.h"
+
+#include "ClientPredictionSpscRing.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionSpscRingEdgesTest, "ClientPrediction.SpscRing.Edges",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionSpscRingEdgesTest::RunTest(const FString& Parameters) {
+    ClientPrediction::TSpscRing<int32> Ring;
+    Ring.SetCapacity(4);
+
+    int32 Value = INDEX_NONE;
+    TestFalse(TEXT("An empty ring has nothing to dequeue"), Ring.Dequeue(Value));
+
+    for (int32 Element = 0; Element < 4; ++Element) {
+        TestTrue(TEXT("A ring accepts elements up to its capacity"), Ring.Enqueue(Element));
+    }
+
+    TestFalse(TEXT("A full ring refuses new elements"), Ring.Enqueue(4));
+
+    for (int32 Element = 0; Element < 4; ++Element) {
+        TestTrue(TEXT("Every accepted element can be dequeued"), Ring.Dequeue(Value));
+        TestEqual(TEXT("Elements are dequeued in the order they were enqueued"), Value, Element);
+    }
+
+    TestFalse(TEXT("A drained ring has nothing to dequeue"), Ring.Dequeue(Value));
+
+    // Wrapping around the slots keeps the order, and discarding empties the ring without changing its capacity.
+    TestTrue(TEXT("A drained ring accepts elements again"), Ring.Enqueue(5) && Ring.Enqueue(6));
+    Ring.Discard();
+
+    TestFalse(TEXT("A discarded ring has nothing to dequeue"), Ring.Dequeue(Value));
+    for (int32 Element = 0; Element < 4; ++Element) {
+        TestTrue(TEXT("A discarded ring accepts elements up to its capacity"), Ring.Enqueue(Element));
+    }
+
+    TestFalse(TEXT("A refilled ring refuses new elements"), Ring.Enqueue(4));
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionSpscRingStressTest, "ClientPrediction.SpscRing.Stress",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionSpscRingStressTest::RunTest(const FString& Parameters) {
+    constexpr int32 kNumElements = 1 << 20;
+
+    // A small capacity keeps the ring at its full and empty edges for most of the run.
+    ClientPrediction::TSpscRing<int32> Ring;
+    Ring.SetCapacity(7);
+
+    TFuture<int32> NumRefused = Async(EAsyncExecution::Thread, [&Ring]() {
+        int32 Refused = 0;
+        for (int32 Element = 0; Element < kNumElements;) {
+            if (Ring.Enqueue(Element)) {
+                ++Element;
+            }
+            else {
+                ++Refused;
+                FPlatformProcess::Yield();
+            }
+        }
+
+        return Refused;
+    });
+
+    int32 NumReceived = 0;
+    int32 NumOutOfOrder = 0;
+    while (NumReceived < kNumElements) {
+        int32 Value = INDEX_NONE;
+        if (!Ring.Dequeue(Value)) {
+            FPlatformProcess::Yield();
+            continue;
+        }
+
+        NumOutOfOrder += Value != NumReceived ? 1 : 0;
+        ++NumReceived;
+    }
+
+    NumRefused.Wait();
+
+    int32 Value = INDEX_NONE;
+    TestEqual(TEXT("Every element arrives exactly once and in order"), NumOutOfOrder, 0);
+    TestFalse(TEXT("Nothing is left once every element has been received"), Ring.Dequeue(Value));
+    AddInfo(FString::Printf(TEXT("The producer found the ring full %d times"), NumRefused.Get()));
+
+    return true;
+}
+
+#endif
@@ -13,8 +13,32 @@ namespace ClientPrediction {
     extern CLIENTPREDICTION_API int32 ClientPredictionSimProxySendInterval;
     extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyBufferTicks;
     extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyCorrectionThreshold;
+    extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyHistoryTicks;
+    extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyMaxBaselineAge;
 
     extern CLIENTPREDICTION_API int32 ClientPredictionInputWindowSize;
+    extern CLIENTPREDICTION_API int32 ClientPredictionAdaptiveInputWindow;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMinInputWindowSize;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMaxInputWindowSize;
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputLossInterval;
+    extern CLIENTPREDICTION_API float ClientPredictionInputTargetLoss;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionAdaptiveInputLead;
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputBufferTicks;
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputBufferSlackTicks;
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputBufferInterval;
+    extern CLIENTPREDICTION_API float ClientPredictionInputLeadStepInterval;
 
     extern CLIENTPREDICTION_API float ClientPredictionSimProxyTickInterval;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionParallelSimTicks;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionDeltaStateBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionFullStateBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionBundleCompressionThreshold;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMaxBundleBytes;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMaxQueuedEventBytes;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMaxHeldEventBytes;
+    extern CLIENTPREDICTION_API int32 ClientPredictionUnreliableEventRedundancy;
 }
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientPredictionSimProxy.h"
+#include "ClientPredictionConnectionManager.generated.h"
+
+/**
+ * Spawned by the authority for every connection and owned by its player controller. Events from all of the sims that a connection can see are sent to
+ * it in one reliable RPC per frame, rather than every sim sending its own reliable multicast.
+ */
+UCLASS(NotPlaceable)
+class CLIENTPREDICTION_API AClientPredictionConnectionManager : public AActor {
+    GENERATED_BODY()
+
+public:
+    AClientPredictionConnectionManager();
+
+    /**
+     * Called on the authority with the event bundles that every sim emitted this frame. Only bundles for sims that are replicated to this connection as
+     * sim proxies are sent. They are held back while more than cp.MaxQueuedEventBytes of reliable data is waiting to be acked by the connection, and
+     * the oldest held bundles are dropped once more than cp.MaxHeldEventBytes are held.
+     */
+    void SendEventBundles(const TArray<FAggregatedBundle>& Bundles);
+
+    /** Called on the authority with the unreliable event bundles that every sim emitted this frame. These are never held back. */
+    void SendUnreliableEventBundles(const TArray<FAggregatedBundle>& Bundles);
+
+private:
+    UFUNCTION(Client, Reliable)
+    void ClientRecvEvents(const TArray<FAggregatedBundle>& Bundles);
+
+    UFUNCTION(Client, Unreliable)
+    void ClientRecvUnreliableEvents(const TArray<FAggregatedBundle>& Bundles);
+
+    void RecvEvents(const TArray<FAggregatedBundle>& Bundles);
+
+    /** Events are only executed by sim proxies, and only actors with an open channel are replicated to the connection. */
+    bool IsSimProxyOnConnection(const FAggregatedBundle& Aggregated) const;
+
+    /** Removes a batch of at most cp.MaxBundleBytes from the front of the bundles. */
+    static TArray<FAggregatedBundle> TakeBatch(TArray<FAggregatedBundle>& Bundles);
+
+    int32 GetQueuedReliableBytes() const;
+
+    /** Drops held bundles whose sim was destroyed or stopped being replicated to the connection, then the oldest ones past cp.MaxHeldEventBytes. */
+    void TrimHeldEventBundles();
+
+    UPROPERTY(Transient)
+    TArray<FAggregatedBundle> HeldEventBundles;
+
+    int32 HeldEventBytes = 0;
+};
@@ -62,10 +62,11 @@ namespace ClientPrediction {
         /**
          * Registers an event for the simulation. The event can be dispatched in SimTickPrePhysicsDelegate or SimTickPostPhysicsDelegate.
          * @tparam EventType The event type to register.
+         * @param Delivery How the authority sends the event to sim proxies. Unreliable events can be lost, but never wait behind lost reliable data.
          * @return The delegate that will be called on the game thread when the event is dispatched.
          */
         template <typename EventType>
-        TMulticastDelegate<void(const EventType&, Chaos::FReal)>& RegisterEvent();
+        TMulticastDelegate<void(const EventType&, Chaos::FReal)>& RegisterEvent(EEventDelivery Delivery = EEventDelivery::kReliable);
 
         /**
          * Generates the initial state for the simulation. This is broadcasted on the physics thread on the authority and auto proxy on the first tick of the simulation.
@@ -138,8 +139,8 @@ namespace ClientPrediction {
 
     template <typename Traits>
     template <typename EventType>
-    TMulticastDelegate<void(const EventType&, Chaos::FReal)>& FSimDelegates<Traits>::RegisterEvent() {
+    TMulticastDelegate<void(const EventType&, Chaos::FReal)>& FSimDelegates<Traits>::RegisterEvent(EEventDelivery Delivery) {
         check(SimEvents != nullptr);
-        return SimEvents->template RegisterEvent<EventType>();
+        return SimEvents->template RegisterEvent<EventType>(Delivery);
     }
 }
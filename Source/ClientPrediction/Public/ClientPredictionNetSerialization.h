@@ -1,12 +1,272 @@
 ﻿#pragma once
 
-#include "Serialization/ArchiveLoadCompressedProxy.h"
-#include "Serialization/ArchiveSaveCompressedProxy.h"
+#include "UObject/CoreNet.h"
 
+#include "ClientPredictionCVars.h"
 #include "ClientPredictionDataCompleteness.h"
 
 #include "ClientPredictionNetSerialization.generated.h"
 
+namespace ClientPrediction {
+    /**
+     * Serialized bundles are never modified once they are written, so copies of a bundle share a single buffer. That covers emitting a bundle into the
+     * replicated property, serializing it to every connection, and handing a received bundle to the physics thread.
+     */
+    using FBundleBuffer = TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>;
+
+    /** Serializes a buffer in the same format as a TArray<uint8>. Loading always takes a new buffer from the pool, since the old one may be shared. */
+    CLIENTPREDICTION_API void NetSerializeBundleBuffer(FArchive& Ar, FBundleBuffer& Buffer);
+
+    template <typename ObjectType>
+    struct TScratchPolicy {
+        static TUniquePtr<ObjectType> Create() { return MakeUnique<ObjectType>(); }
+
+        /** Arrays keep their allocation when they are reset. */
+        static void Reset(ObjectType& Object) { Object.Reset(); }
+    };
+
+    template <>
+    struct TScratchPolicy<FNetBitWriter> {
+        static TUniquePtr<FNetBitWriter> Create() {
+            // Bundles are usually small, but a backlog of packets can grow past this so the writer is allowed to resize.
+            TUniquePtr<FNetBitWriter> Writer = MakeUnique<FNetBitWriter>(nullptr, TNumericLimits<uint16>::Max());
+            Writer->SetAllowResize(true);
+
+            return Writer;
+        }
+
+        static void Reset(FNetBitWriter& Writer) { Writer.Reset(); }
+    };
+
+    /**
+     * Borrows an object that belongs to the calling thread and is reused between borrows, so the writers and arrays used to emit and consume bundles stop
+     * allocating once they have grown to the largest bundle seen. Borrows can be nested (a packet serializing a nested bundle, for example) and are
+     * returned in reverse order. The object is reset when it is returned.
+     */
+    template <typename ObjectType>
+    class TScopedScratch : public FNoncopyable {
+    public:
+        TScopedScratch();
+        ~TScopedScratch();
+
+        ObjectType& operator*() const { return *Object; }
+        ObjectType* operator->() const { return Object; }
+
+    private:
+        struct FPool {
+            TArray<TUniquePtr<ObjectType>> Objects;
+            int32 NumInUse = 0;
+        };
+
+        static FPool& GetPool() {
+            static thread_local FPool Pool;
+            return Pool;
+        }
+
+        ObjectType* Object = nullptr;
+    };
+
+    template <typename ObjectType>
+    TScopedScratch<ObjectType>::TScopedScratch() {
+        FPool& Pool = GetPool();
+        if (Pool.NumInUse == Pool.Objects.Num()) {
+            Pool.Objects.Add(TScratchPolicy<ObjectType>::Create());
+        }
+
+        Object = Pool.Objects[Pool.NumInUse++].Get();
+    }
+
+    template <typename ObjectType>
+    TScopedScratch<ObjectType>::~TScopedScratch() {
+        FPool& Pool = GetPool();
+        check(Pool.NumInUse > 0 && Pool.Objects[Pool.NumInUse - 1].Get() == Object);
+
+        TScratchPolicy<ObjectType>::Reset(*Object);
+        --Pool.NumInUse;
+    }
+
+    /**
+     * A bit reader that reads a scratch buffer in place. FNetBitReader copies whatever it's constructed with into a buffer of its own, so the reader
+     * borrows the scratch buffer's allocation instead and hands it back when it goes out of scope.
+     */
+    class FScratchBitReader : public FNetBitReader {
+    public:
+        FScratchBitReader(TArray<uint8>& InBits, int64 NumBits);
+        ~FScratchBitReader();
+
+    private:
+        TArray<uint8>& Bits;
+    };
+
+    inline FScratchBitReader::FScratchBitReader(TArray<uint8>& InBits, int64 NumBits) : Bits(InBits) {
+        SetData(MoveTemp(Bits), NumBits);
+    }
+
+    inline FScratchBitReader::~FScratchBitReader() {
+        Bits = MoveTemp(Buffer);
+    }
+
+    /**
+     * Counts the objects that TSharedObjectPool had to allocate and the ones it deleted because its free list was full. Once every pool has warmed up
+     * both stay at zero. Printed and reset with cp.BundlePoolStats.
+     */
+    struct CLIENTPREDICTION_API FBundlePoolStats {
+        static void RecordAllocation();
+        static void RecordDiscard();
+        static void LogAndReset();
+    };
+
+    /**
+     * Hands out shared objects that go back to a free list once every reference to them has been released, so the buffers that bundles share between
+     * copies and connections stop allocating once the pool has grown to the number that are alive at once. Objects that are held for a long time, like
+     * the baselines the net driver keeps per connection, don't slow down acquiring the others. The object keeps whatever its previous user left in it.
+     * Any thread may acquire and release objects.
+     */
+    template <typename ObjectType>
+    class TSharedObjectPool {
+    public:
+        using FObjectRef = TSharedRef<ObjectType, ESPMode::ThreadSafe>;
+
+        static FObjectRef Acquire();
+
+    private:
+        // Past this many free objects released ones are deleted, so a burst doesn't keep its memory around forever.
+        static constexpr int32 kMaxFreeObjects = 1024;
+
+        /**
+         * Counts the references to a pooled object like the controller MakeShared creates. The object isn't destroyed when the last shared reference goes
+         * away, and once the weak references are gone too the controller's block is returned to the free list rather than deleted.
+         */
+        class FController : public SharedPointerInternals::TReferenceControllerBase<ESPMode::ThreadSafe> {
+        public:
+            virtual void DestroyObject() override {}
+            static void operator delete(void* Memory);
+        };
+
+        // The controller comes first, so its address is the block's.
+        struct FBlock {
+            FBlock() { new(Object.GetTypedPtr()) ObjectType(); }
+            ~FBlock() { Object.GetTypedPtr()->~ObjectType(); }
+
+            TTypeCompatibleBytes<FController> Controller;
+            TTypeCompatibleBytes<ObjectType> Object;
+        };
+
+        struct FPool {
+            FCriticalSection Mutex;
+            TArray<FBlock*> FreeBlocks;
+        };
+
+        static FPool& GetPool() {
+            // Never destroyed, since static destructors can release references after the pool would have been.
+            static FPool* Pool = new FPool();
+            return *Pool;
+        }
+
+        static void Release(FBlock* Block);
+    };
+
+    template <typename ObjectType>
+    typename TSharedObjectPool<ObjectType>::FObjectRef TSharedObjectPool<ObjectType>::Acquire() {
+        FPool& Pool = GetPool();
+
+        FBlock* Block = nullptr;
+        {
+            FScopeLock PoolLock(&Pool.Mutex);
+            if (!Pool.FreeBlocks.IsEmpty()) { Block = Pool.FreeBlocks.Pop(EAllowShrinking::No); }
+        }
+
+        if (Block == nullptr) {
+            Block = new FBlock();
+            FBundlePoolStats::RecordAllocation();
+        }
+
+        FController* Controller = ::new(Block->Controller.GetTypedPtr()) FController();
+        return UE::Core::Private::MakeSharedRef<ObjectType, ESPMode::ThreadSafe>(Block->Object.GetTypedPtr(), Controller);
+    }
+
+    template <typename ObjectType>
+    void TSharedObjectPool<ObjectType>::FController::operator delete(void* Memory) {
+        Release(reinterpret_cast<FBlock*>(Memory));
+    }
+
+    template <typename ObjectType>
+    void TSharedObjectPool<ObjectType>::Release(FBlock* Block) {
+        FPool& Pool = GetPool();
+        {
+            FScopeLock PoolLock(&Pool.Mutex);
+            if (Pool.FreeBlocks.Num() < kMaxFreeObjects) {
+                Pool.FreeBlocks.Add(Block);
+                return;
+            }
+        }
+
+        delete Block;
+        FBundlePoolStats::RecordDiscard();
+    }
+
+    /** Written in the header of every bundle. Receivers reject bundles with any other version. */
+    static constexpr uint8 kBundleFormatVersion = 3;
+
+    /** Packets with a ServerTick have it written by the bundle, relative to the previous packet, rather than by the packet itself. */
+    template <typename Packet, typename = void>
+    struct TIsTickedPacket : std::false_type {};
+
+    template <typename Packet>
+    struct TIsTickedPacket<Packet, std::void_t<decltype(DeclVal<Packet&>().ServerTick)>> : std::true_type {};
+
+    /**
+     * The first tick in a bundle is written in full, every tick after that is written as a zigzag encoded difference to the previous one. Consecutive
+     * states and inputs are only a few ticks apart, so those take a single byte.
+     */
+    CLIENTPREDICTION_API void NetSerializePacketTick(FArchive& Ar, int32& Tick, TOptional<int32>& PreviousTick);
+
+    /**
+     * Packets with a NetSerializeDelta(Ar, Userdata, Previous) are written relative to the packet before them in the same bundle. The first packet of
+     * every bundle is written in full with NetSerialize, so a bundle never depends on another one having arrived.
+     */
+    template <typename Packet, typename UserdataType, typename = void>
+    struct TIsDeltaPacket : std::false_type {};
+
+    template <typename Packet, typename UserdataType>
+    struct TIsDeltaPacket<Packet, UserdataType, std::void_t<decltype(DeclVal<Packet&>().NetSerializeDelta(
+                                                    DeclVal<FArchive&>(), DeclVal<UserdataType>(), DeclVal<const Packet&>()))>> : std::true_type {};
+
+    /** The compression applied to a serialized bundle. Sent with every bundle, so the order can't change. */
+    enum class EBundleCodec : uint8 {
+        kNone = 0,
+        kLZ4,
+        kOodle,
+        kZlib,
+        kCount
+    };
+
+    struct CLIENTPREDICTION_API FBundleCodecs {
+        /** The codec configured for bundles of a completeness with cp.BundleCodec and cp.FullStateBundleCodec. */
+        static EBundleCodec GetCodec(EDataCompleteness Completeness);
+
+        /** The codec configured for delta encoded sim proxy states with cp.DeltaStateBundleCodec. */
+        static EBundleCodec GetDeltaStateCodec();
+
+        /**
+         * Compresses Bits into OutCompressed and returns the codec that was used. Bundles smaller than cp.BundleCompressionThreshold, or that don't get
+         * any smaller, are left uncompressed and kNone is returned.
+         */
+        static EBundleCodec Compress(EBundleCodec Codec, const TArray<uint8>& Bits, TArray<uint8>& OutCompressed);
+        static bool Decompress(EBundleCodec Codec, const TArray<uint8>& Compressed, int32 NumBytes, TArray<uint8>& OutBits);
+
+        /** The compression format behind a codec, or NAME_None for kNone. */
+        static FName GetFormatName(EBundleCodec Codec);
+    };
+
+    /** Tracks how often bundles are compressed versus served from the compressed cache. Printed and reset with cp.BundleCompressionStats. */
+    struct CLIENTPREDICTION_API FBundleCompressionStats {
+        static void RecordCompression(int32 NumUncompressedBytes, int32 NumCompressedBytes);
+        static void RecordCacheHit();
+        static void LogAndReset();
+    };
+}
+
 template <ClientPrediction::EDataCompleteness Completeness>
 struct FPacketBundle {
     void Copy(const FPacketBundle& Other);
@@ -14,12 +274,28 @@ struct FPacketBundle {
     template <typename Packet, typename UserdataType>
     void Store(TArray<Packet>& Packets, UserdataType Userdata);
 
+    /**
+     * Stores the packets in as many bundles as it takes to keep each of them under cp.MaxBundleBytes and passes each one to Emit. This keeps a backlog of
+     * packets from turning into a single oversized bunch. A packet that is larger than the limit on its own gets a bundle to itself.
+     */
+    template <typename Packet, typename UserdataType, typename EmitFunc>
+    static void StoreChunked(TArray<Packet>& Packets, UserdataType Userdata, EmitFunc&& Emit);
+
     template <typename Packet, typename UserdataType>
     bool Retrieve(TArray<Packet>& Packets, UserdataType Userdata) const;
 
     bool HasData() const;
+    int32 GetNumBytes() const { return NumberOfBits > 0 ? FMath::DivideAndRoundUp(NumberOfBits, 8) : 0; }
 
 private:
+    /** Stores packets starting at FirstPacket until the bundle would grow past MaxBits. Returns the index of the first packet that wasn't stored. */
+    template <typename Packet, typename UserdataType>
+    int32 StoreRange(TArray<Packet>& Packets, int32 FirstPacket, UserdataType Userdata, int64 MaxBits);
+
+    template <typename Packet, typename UserdataType>
+    void NetSerializePacketWithTick(Packet& PacketToSerialize, const Packet* PreviousPacket, UserdataType Userdata, FArchive& Ar,
+                                    TOptional<int32>& PreviousTick) const;
+
     template <typename Packet, typename UserdataType>
     void NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const;
 
@@ -28,9 +304,17 @@ public:
     bool Identical(const FPacketBundle* Other, uint32 PortFlags) const;
 
 private:
-    TArray<uint8> SerializedBits;
+    ClientPrediction::FBundleBuffer SerializedBits;
     int32 NumberOfBits = INDEX_NONE;
     uint64 Sequence = 0;
+
+    // The bundle is serialized once for every connection it's replicated to, so the compressed bits are kept until the sequence changes.
+    ClientPrediction::FBundleBuffer CompressedBits;
+    uint64 CompressedSequence = TNumericLimits<uint64>::Max();
+    ClientPrediction::EBundleCodec CompressedCodec = ClientPrediction::EBundleCodec::kNone;
+
+    // Received bundles are only decompressed when they are retrieved, which is usually on the physics thread rather than the game thread.
+    ClientPrediction::EBundleCodec ReceivedCodec = ClientPrediction::EBundleCodec::kNone;
 };
 
 template <ClientPrediction::EDataCompleteness Completeness>
@@ -44,33 +328,103 @@ void FPacketBundle<Completeness>::Copy(const FPacketBundle& Other) {
 template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
 void FPacketBundle<Completeness>::Store(TArray<Packet>& Packets, UserdataType Userdata) {
-    check(Packets.Num() < TNumericLimits<uint8>::Max());
+    StoreRange(Packets, 0, Userdata, TNumericLimits<int64>::Max());
+}
 
-    FNetBitWriter Writer(nullptr, TNumericLimits<uint16>::Max());
-    uint8 NumPackets = static_cast<uint8>(Packets.Num());
-    Writer << NumPackets;
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType, typename EmitFunc>
+void FPacketBundle<Completeness>::StoreChunked(TArray<Packet>& Packets, UserdataType Userdata, EmitFunc&& Emit) {
+    const int64 MaxBits = static_cast<int64>(FMath::Max(ClientPrediction::ClientPredictionMaxBundleBytes, 1)) * 8;
+
+    int32 NextPacket = 0;
+    do {
+        FPacketBundle Bundle{};
+        NextPacket = Bundle.StoreRange(Packets, NextPacket, Userdata, MaxBits);
+        Emit(Bundle);
+    }
+    while (NextPacket < Packets.Num());
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType>
+int32 FPacketBundle<Completeness>::StoreRange(TArray<Packet>& Packets, int32 FirstPacket, UserdataType Userdata, int64 MaxBits) {
+    ClientPrediction::TScopedScratch<FNetBitWriter> Writer;
+    TOptional<int32> PreviousTick;
+
+    // Every packet is preceded by a set bit and the bundle ends with a cleared one, so there is no limit on the number of packets.
+    int64 EndOfPackets = 0;
+    int32 PacketIdx = FirstPacket;
+    for (; PacketIdx < Packets.Num(); ++PacketIdx) {
+        uint8 bHasPacket = 1;
+        Writer->SerializeBits(&bHasPacket, 1);
+
+        const Packet* PreviousPacket = PacketIdx > FirstPacket ? &Packets[PacketIdx - 1] : nullptr;
+        NetSerializePacketWithTick(Packets[PacketIdx], PreviousPacket, Userdata, *Writer, PreviousTick);
+
+        if (Writer->GetNumBits() + 1 > MaxBits && PacketIdx > FirstPacket) { break; }
+        EndOfPackets = Writer->GetNumBits();
+    }
 
-    for (Packet& PacketToWrite : Packets) {
-        NetSerializePacket(PacketToWrite, Userdata, Writer);
+    if (PacketIdx == Packets.Num()) {
+        uint8 bHasPacket = 0;
+        Writer->SerializeBits(&bHasPacket, 1);
     }
 
-    SerializedBits = *Writer.GetBuffer();
-    NumberOfBits = Writer.GetNumBits();
+    // Only the bytes that were written are kept. If a packet didn't fit, everything it wrote is cleared, which leaves a cleared bit to end the bundle.
+    const int64 NumBits = EndOfPackets + 1;
+    TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Bits = ClientPrediction::TSharedObjectPool<TArray<uint8>>::Acquire();
+    Bits->Reset();
+    Bits->Append(Writer->GetData(), static_cast<int32>(FMath::DivideAndRoundUp<int64>(NumBits, 8)));
+    (*Bits)[EndOfPackets >> 3] &= static_cast<uint8>((1u << (EndOfPackets & 7)) - 1u);
+
+    SerializedBits = Bits;
+    NumberOfBits = static_cast<int32>(NumBits);
     ++Sequence;
+
+    return PacketIdx;
 }
 
 template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
 bool FPacketBundle<Completeness>::Retrieve(TArray<Packet>& Packets, UserdataType Userdata) const {
-    if (NumberOfBits == -1) { return false; }
+    if (NumberOfBits <= 0) { return false; }
+
+    // The reader needs a buffer of its own, so the bits are decompressed or copied into a scratch buffer that it reads in place.
+    ClientPrediction::TScopedScratch<TArray<uint8>> Bits;
 
-    FNetBitReader BitReader(nullptr, SerializedBits.GetData(), NumberOfBits);
-    uint8 NumPackets = 0;
-    BitReader << NumPackets;
+    const int32 NumBytes = FMath::DivideAndRoundUp(NumberOfBits, 8);
+    if (ReceivedCodec != ClientPrediction::EBundleCodec::kNone) {
+        if (CompressedBits == nullptr || !ClientPrediction::FBundleCodecs::Decompress(ReceivedCodec, *CompressedBits, NumBytes, *Bits)) {
+            return false;
+        }
+    }
+    else if (SerializedBits != nullptr && SerializedBits->Num() >= NumBytes) {
+        Bits->Append(SerializedBits->GetData(), NumBytes);
+    }
+
+    if (Bits->Num() < NumBytes) { return false; }
+
+    ClientPrediction::FScratchBitReader BitReader(*Bits, NumberOfBits);
+    TOptional<int32> PreviousTick;
+    const int32 FirstPacket = Packets.Num();
+
+    uint8 bHasPacket = 0;
+    BitReader.SerializeBits(&bHasPacket, 1);
+
+    while (bHasPacket != 0 && !BitReader.IsError()) {
+        // Adding the packet can reallocate the array, so the previous packet is only looked up afterwards.
+        const int32 PacketIdx = Packets.AddDefaulted();
+        const Packet* PreviousPacket = PacketIdx > FirstPacket ? &Packets[PacketIdx - 1] : nullptr;
+        NetSerializePacketWithTick(Packets[PacketIdx], PreviousPacket, Userdata, BitReader, PreviousTick);
+
+        bHasPacket = 0;
+        BitReader.SerializeBits(&bHasPacket, 1);
+    }
 
-    for (uint8 PacketIdx = 0; PacketIdx < NumPackets; ++PacketIdx) {
-        Packets.AddDefaulted();
-        NetSerializePacket(Packets.Last(), Userdata, BitReader);
+    // A truncated bundle leaves the last packet partially read.
+    if (BitReader.IsError()) {
+        if (!Packets.IsEmpty()) { Packets.Pop(); }
+        return false;
     }
 
     return true;
@@ -79,6 +433,24 @@ bool FPacketBundle<Completeness>::Retrieve(TArray<Packet>& Packets, UserdataType
 template <ClientPrediction::EDataCompleteness Completeness>
 bool FPacketBundle<Completeness>::HasData() const { return NumberOfBits != INDEX_NONE; }
 
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType>
+void FPacketBundle<Completeness>::NetSerializePacketWithTick(Packet& PacketToSerialize, const Packet* PreviousPacket, UserdataType Userdata, FArchive& Ar,
+                                                             TOptional<int32>& PreviousTick) const {
+    if constexpr (ClientPrediction::TIsTickedPacket<Packet>::value) {
+        ClientPrediction::NetSerializePacketTick(Ar, PacketToSerialize.ServerTick, PreviousTick);
+    }
+
+    if constexpr (ClientPrediction::TIsDeltaPacket<Packet, UserdataType>::value) {
+        if (PreviousPacket != nullptr) {
+            PacketToSerialize.NetSerializeDelta(Ar, Userdata, *PreviousPacket);
+            return;
+        }
+    }
+
+    NetSerializePacket(PacketToSerialize, Userdata, Ar);
+}
+
 template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
 void FPacketBundle<Completeness>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
@@ -91,32 +463,48 @@ void FPacketBundle<ClientPrediction::EDataCompleteness::kFull>::NetSerializePack
     PacketToSerialize.NetSerialize(Ar, ClientPrediction::EDataCompleteness::kFull, Userdata);
 }
 
-template <>
-template <typename Packet, typename UserdataType>
-void FPacketBundle<ClientPrediction::EDataCompleteness::kLow>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
-    PacketToSerialize.NetSerialize(Ar, ClientPrediction::EDataCompleteness::kLow, Userdata);
-}
-
 template <ClientPrediction::EDataCompleteness Completeness>
 bool FPacketBundle<Completeness>::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+    using namespace ClientPrediction;
+
     if (Ar.IsLoading()) {
-        TArray<uint8> CompressedBuffer;
+        uint8 Header = 0;
         Ar << NumberOfBits;
-        Ar << CompressedBuffer;
+        Ar << Header;
+
+        const uint8 Version = Header >> 4;
+        const uint8 Codec = Header & 0xF;
+        if (Version != kBundleFormatVersion || Codec >= static_cast<uint8>(EBundleCodec::kCount)) {
+            Ar.SetError();
+            bOutSuccess = false;
+            return false;
+        }
 
-        FArchiveLoadCompressedProxy Decompressor(CompressedBuffer, NAME_Zlib);
-        Decompressor << SerializedBits;
+        ReceivedCodec = static_cast<EBundleCodec>(Codec);
+        NetSerializeBundleBuffer(Ar, ReceivedCodec == EBundleCodec::kNone ? SerializedBits : CompressedBits);
 
         ++Sequence;
     }
     else {
-        TArray<uint8> CompressedBuffer;
-        FArchiveSaveCompressedProxy Compressor(CompressedBuffer, NAME_Zlib);
-        Compressor << SerializedBits;
-        Compressor.Flush();
+        if (CompressedSequence != Sequence && SerializedBits != nullptr) {
+            TSharedRef<TArray<uint8>, ESPMode::ThreadSafe> Compressed = TSharedObjectPool<TArray<uint8>>::Acquire();
+            Compressed->Reset();
+
+            CompressedCodec = FBundleCodecs::Compress(FBundleCodecs::GetCodec(Completeness), *SerializedBits, *Compressed);
+            CompressedBits = CompressedCodec == EBundleCodec::kNone ? nullptr : ClientPrediction::FBundleBuffer(Compressed);
+            CompressedSequence = Sequence;
 
+            FBundleCompressionStats::RecordCompression(SerializedBits->Num(), CompressedBits != nullptr ? CompressedBits->Num() : SerializedBits->Num());
+        }
+        else {
+            FBundleCompressionStats::RecordCacheHit();
+        }
+
+        uint8 Header = static_cast<uint8>(kBundleFormatVersion << 4) | static_cast<uint8>(CompressedCodec);
         Ar << NumberOfBits;
-        Ar << CompressedBuffer;
+        Ar << Header;
+
+        NetSerializeBundleBuffer(Ar, CompressedCodec == EBundleCodec::kNone ? SerializedBits : CompressedBits);
     }
 
     bOutSuccess = true;
@@ -155,13 +543,13 @@ struct TStructOpsTypeTraits<FBundledPackets> : public TStructOpsTypeTraitsBase2<
 };
 
 USTRUCT()
-struct FBundledPacketsLow {
+struct FBundledPacketsFull {
     GENERATED_BODY()
 
-    using BundleType = FPacketBundle<ClientPrediction::EDataCompleteness::kLow>;
+    using BundleType = FPacketBundle<ClientPrediction::EDataCompleteness::kFull>;
 
     bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
-    bool Identical(const FBundledPacketsLow* Other, uint32 PortFlags) const;
+    bool Identical(const FBundledPacketsFull* Other, uint32 PortFlags) const;
 
     BundleType& Bundle() const { return Impl; }
     bool HasData() const { return Impl.HasData(); }
@@ -171,33 +559,69 @@ private:
 };
 
 template <>
-struct TStructOpsTypeTraits<FBundledPacketsLow> : public TStructOpsTypeTraitsBase2<FBundledPacketsLow> {
+struct TStructOpsTypeTraits<FBundledPacketsFull> : public TStructOpsTypeTraitsBase2<FBundledPacketsFull> {
     enum {
         WithNetSerializer = true,
         WithIdentical = true
     };
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace ClientPrediction {
+    /** A state that has been sent to a connection. Later states sent to that connection are encoded as deltas against it. */
+    struct FStateBaseline {
+        virtual ~FStateBaseline() = default;
+    };
+
+    /** Writes the packets of a FBundledPacketsDelta for a connection. */
+    struct FDeltaEncoder {
+        virtual ~FDeltaEncoder() = default;
+
+        /** Writes the packets relative to Baseline, or as a keyframe if Baseline is null. Returns the baseline that the connection has once it receives them. */
+        virtual TSharedPtr<FStateBaseline> Encode(FBitWriter& Writer, const FStateBaseline* Baseline) const = 0;
+    };
+
+    /** Tracks how many bits delta encoded states take on the wire. Printed and reset with cp.StateBandwidthStats. */
+    struct CLIENTPREDICTION_API FStateBandwidthStats {
+        static void Record(int64 NumBits, int32 NumStates, bool bIsKeyframe);
+        static void LogAndReset();
+    };
+}
+
+/**
+ * Packets that are delta encoded separately for every connection. Instead of storing serialized packets, the authority stores an encoder that is run when
+ * the bundle is replicated to a connection, with the baseline that the connection was last sent. If a packet is dropped the engine reverts the baseline of
+ * that connection to the one before it, and receivers drop any packet whose baseline they don't have. Every connection gets its own payload, so it is
+ * compressed with cp.DeltaStateBundleCodec each time it's sent rather than cached like the other bundles.
+ */
 USTRUCT()
-struct FBundledPacketsFull {
+struct CLIENTPREDICTION_API FBundledPacketsDelta {
     GENERATED_BODY()
 
-    using BundleType = FPacketBundle<ClientPrediction::EDataCompleteness::kFull>;
+    void Copy(const FBundledPacketsDelta& Other);
+    void SetEncoder(const TSharedRef<const ClientPrediction::FDeltaEncoder, ESPMode::ThreadSafe>& NewEncoder);
 
-    bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
-    bool Identical(const FBundledPacketsFull* Other, uint32 PortFlags) const;
+    bool Retrieve(TFunctionRef<void(FArchive& Ar)> Decoder) const;
+    bool HasData() const { return NumberOfBits != INDEX_NONE; }
 
-    BundleType& Bundle() const { return Impl; }
-    bool HasData() const { return Impl.HasData(); }
+    bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
 
 private:
-    mutable BundleType Impl;
+    TSharedPtr<const ClientPrediction::FDeltaEncoder, ESPMode::ThreadSafe> Encoder;
+
+    ClientPrediction::FBundleBuffer SerializedBits;
+    int32 NumberOfBits = INDEX_NONE;
+    uint64 Sequence = 0;
+
+    // Like the other bundles, received payloads are only decompressed when they are retrieved on the physics thread.
+    ClientPrediction::FBundleBuffer CompressedBits;
+    ClientPrediction::EBundleCodec ReceivedCodec = ClientPrediction::EBundleCodec::kNone;
 };
 
 template <>
-struct TStructOpsTypeTraits<FBundledPacketsFull> : public TStructOpsTypeTraitsBase2<FBundledPacketsFull> {
+struct TStructOpsTypeTraits<FBundledPacketsDelta> : public TStructOpsTypeTraitsBase2<FBundledPacketsDelta> {
     enum {
-        WithNetSerializer = true,
-        WithIdentical = true
+        WithNetDeltaSerializer = true
     };
 };
@@ -5,6 +5,46 @@
 #include "ClientPredictionDataCompleteness.h"
 
 namespace ClientPrediction {
+    struct FPhysState;
+
+    /**
+     * How precisely a sim's physics state is sent. Sims can override the default by declaring
+     * static constexpr FPhysQuantization kPhysQuantization{...}; in their traits.
+     */
+    struct CLIENTPREDICTION_API FPhysQuantization {
+        /** Positions are sent in steps of PositionPrecision, and clamped to +/- PositionRange on every axis. */
+        Chaos::FReal PositionPrecision = 0.01;
+        Chaos::FReal PositionRange = 2097152.0;
+
+        /** Rotations are sent as the three smallest quaternion components with this many bits each, plus two bits for the index of the largest. */
+        int32 RotationBits = 15;
+
+        /** Full states are sent with full precision unless this is set. Positions and rotations then use the same quantization as low states. */
+        bool bQuantizeFullStates = false;
+
+        /** Only used when bQuantizeFullStates is set. */
+        bool bQuantizeVelocities = false;
+        Chaos::FReal VelocityPrecision = 0.01;
+        Chaos::FReal VelocityRange = 65536.0;
+        Chaos::FReal AngularVelocityPrecision = 0.001;
+        Chaos::FReal AngularVelocityRange = 1024.0;
+
+        static const FPhysQuantization& Default();
+
+        /** Snaps the state to exactly what a receiver decodes after it's sent with this completeness. */
+        void Quantize(FPhysState& State, EDataCompleteness Completeness) const;
+    };
+
+    template <typename Traits, typename = void>
+    struct TSimPhysQuantization {
+        static const FPhysQuantization& Get() { return FPhysQuantization::Default(); }
+    };
+
+    template <typename Traits>
+    struct TSimPhysQuantization<Traits, std::void_t<decltype(Traits::kPhysQuantization)>> {
+        static const FPhysQuantization& Get() { return Traits::kPhysQuantization; }
+    };
+
     CLIENTPREDICTION_API struct FPhysState {
         /** These mirror the Chaos properties for a particle */
         Chaos::EObjectStateType ObjectState = Chaos::EObjectStateType::Uninitialized;
@@ -17,7 +57,33 @@ namespace ClientPrediction {
 
         CLIENTPREDICTION_API bool ShouldReconcile(const FPhysState& State) const;
         CLIENTPREDICTION_API void NetSerialize(FArchive& Ar, EDataCompleteness Completeness);
+        CLIENTPREDICTION_API void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, const FPhysQuantization& Quantization);
         CLIENTPREDICTION_API void Interpolate(const FPhysState& Other, Chaos::FReal Alpha);
+
+        /** Writes only the interpolated transform between two states, the velocities are left untouched. */
+        CLIENTPREDICTION_API void InterpolateTransform(const FPhysState& Start, const FPhysState& End, Chaos::FReal Alpha);
         CLIENTPREDICTION_API void Extrapolate(const FPhysState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime);
     };
+
+    /**
+     * The transform of a sim proxy state quantized to the precision it is sent with. Deltas are taken between quantized states so that the authority and the
+     * sim proxy agree exactly on the baseline, no matter how many deltas are chained together.
+     */
+    struct CLIENTPREDICTION_API FQuantizedPhysState {
+        int32 X[3] = {0, 0, 0};
+
+        /**
+         * The rotation is kept as the index of its largest component and the other three, in the same smallest three form that low states are sent in.
+         * The components are signed so that the default is the identity whatever RotationBits is.
+         */
+        uint32 LargestComponent = 3;
+        int32 R[3] = {0, 0, 0};
+
+        /** Positions use the precision of the profile, the rotation components span RotationBits bits each. */
+        static FQuantizedPhysState Quantize(const FPhysState& State, const FPhysQuantization& Quantization);
+        void Dequantize(FPhysState& State, const FPhysQuantization& Quantization) const;
+
+        /** Serializes the difference to Baseline, so components that barely changed only take a few bits. */
+        void NetSerializeDelta(FArchive& Ar, const FQuantizedPhysState& Baseline);
+    };
 }
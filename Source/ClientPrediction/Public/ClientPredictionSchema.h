@@ -0,0 +1,334 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include <tuple>
+
+#include "ClientPredictionDataCompleteness.h"
+
+namespace ClientPrediction {
+    /**
+     * Describes a single member of a state or input. Fields are created with Field(&FMyState::Member) and refined with the With* functions, for example
+     * Field(&FMyState::Speed).WithRange(-2000.0, 2000.0).WithPrecision(0.01).WithTolerance(0.5).
+     *
+     * Floating point members are quantized to Precision within the range when both are set. Integer and enum members are packed into just enough bits
+     * for the range when one is set. Everything else is sent as is.
+     */
+    template <typename ObjectType, typename MemberType>
+    struct TSchemaField {
+        MemberType ObjectType::* Member = nullptr;
+
+        double Min = 0.0;
+        double Max = 0.0;
+        bool bHasRange = false;
+
+        double Precision = 0.0;
+        double Tolerance = 0.0;
+        bool bFullOnly = false;
+
+        constexpr TSchemaField WithRange(double NewMin, double NewMax) const {
+            TSchemaField NewField = *this;
+            NewField.Min = NewMin;
+            NewField.Max = NewMax;
+            NewField.bHasRange = true;
+
+            return NewField;
+        }
+
+        constexpr TSchemaField WithPrecision(double NewPrecision) const {
+            TSchemaField NewField = *this;
+            NewField.Precision = NewPrecision;
+
+            return NewField;
+        }
+
+        /**
+         * A correction is only applied if the predicted and authoritative values differ by more than this. Quantized values are compared as they are sent,
+         * so a field only needs a tolerance on top of its precision if small mispredictions should be ignored too.
+         */
+        constexpr TSchemaField WithTolerance(double NewTolerance) const {
+            TSchemaField NewField = *this;
+            NewField.Tolerance = NewTolerance;
+
+            return NewField;
+        }
+
+        /** The field is only sent to auto proxies. Sim proxies keep the default value. */
+        constexpr TSchemaField FullOnly() const {
+            TSchemaField NewField = *this;
+            NewField.bFullOnly = true;
+
+            return NewField;
+        }
+
+        bool IsSent(EDataCompleteness Completeness) const { return !bFullOnly || Completeness == EDataCompleteness::kFull; }
+        bool IsQuantized() const { return bHasRange && Precision > 0.0 && Max > Min; }
+
+        uint32 NumSteps() const {
+            return static_cast<uint32>(FMath::Clamp((Max - Min) / Precision + 1.0, 2.0, static_cast<double>(TNumericLimits<uint32>::Max())));
+        }
+
+        uint32 Quantize(double Value) const {
+            const double Step = FMath::RoundToDouble((FMath::Clamp(Value, Min, Max) - Min) / Precision);
+            return static_cast<uint32>(FMath::Clamp(Step, 0.0, static_cast<double>(NumSteps() - 1)));
+        }
+
+        double Dequantize(uint32 Step) const { return Min + Step * Precision; }
+
+        /** The value the receiver ends up with once it has been sent. */
+        double SentValue(double Value) const { return IsQuantized() ? Dequantize(Quantize(Value)) : Value; }
+
+        void NetSerialize(FArchive& Ar, ObjectType& Object) const;
+        bool IsIdentical(const ObjectType& Object, const ObjectType& Other) const;
+        void Interpolate(ObjectType& Object, const ObjectType& Other, double Alpha) const;
+        bool ShouldReconcile(const ObjectType& Object, const ObjectType& Other) const;
+    };
+
+    template <typename ObjectType, typename MemberType>
+    constexpr TSchemaField<ObjectType, MemberType> Field(MemberType ObjectType::* Member) {
+        TSchemaField<ObjectType, MemberType> NewField{};
+        NewField.Member = Member;
+
+        return NewField;
+    }
+
+    /** How a field of a given type is serialized, compared and interpolated. */
+    template <typename MemberType, typename = void>
+    struct TSchemaFieldCodec;
+
+    template <>
+    struct TSchemaFieldCodec<bool> {
+        template <typename FieldType>
+        static void NetSerialize(FArchive& Ar, bool& Value, const FieldType& Field) {
+            uint8 Bit = Value ? 1 : 0;
+            Ar.SerializeBits(&Bit, 1);
+            Value = Bit != 0;
+        }
+
+        template <typename FieldType>
+        static bool IsIdentical(bool Value, bool Other, const FieldType& Field) { return Value == Other; }
+
+        static void Interpolate(bool& Value, bool Other, double Alpha) { Value = Alpha < 0.5 ? Value : Other; }
+
+        template <typename FieldType>
+        static bool ShouldReconcile(bool Value, bool Other, const FieldType& Field) { return Value != Other; }
+    };
+
+    template <typename MemberType>
+    struct TSchemaFieldCodec<MemberType, std::enable_if_t<std::is_floating_point_v<MemberType>>> {
+        template <typename FieldType>
+        static void NetSerialize(FArchive& Ar, MemberType& Value, const FieldType& Field) {
+            if (!Field.IsQuantized()) {
+                Ar << Value;
+                return;
+            }
+
+            uint32 Step = Ar.IsSaving() ? Field.Quantize(Value) : 0;
+            Ar.SerializeInt(Step, Field.NumSteps());
+
+            if (Ar.IsLoading()) { Value = static_cast<MemberType>(Field.Dequantize(Step)); }
+        }
+
+        template <typename FieldType>
+        static bool IsIdentical(MemberType Value, MemberType Other, const FieldType& Field) {
+            return Field.IsQuantized() ? Field.Quantize(Value) == Field.Quantize(Other) : Value == Other;
+        }
+
+        static void Interpolate(MemberType& Value, MemberType Other, double Alpha) { Value = FMath::Lerp(Value, Other, static_cast<MemberType>(Alpha)); }
+
+        template <typename FieldType>
+        static bool ShouldReconcile(MemberType Value, MemberType Other, const FieldType& Field) {
+            // The authoritative value arrives quantized, so the predicted one is quantized the same way before they are compared.
+            return FMath::Abs(Field.SentValue(Value) - Field.SentValue(Other)) > Field.Tolerance;
+        }
+    };
+
+    template <typename MemberType>
+    struct TSchemaFieldCodec<MemberType, std::enable_if_t<(std::is_integral_v<MemberType> && !std::is_same_v<MemberType, bool>) || std::is_enum_v<MemberType>>> {
+        template <typename Type, bool bIsEnum = std::is_enum_v<Type>>
+        struct TIntegerType {
+            using FType = Type;
+        };
+
+        template <typename Type>
+        struct TIntegerType<Type, true> {
+            using FType = std::underlying_type_t<Type>;
+        };
+
+        using IntegerType = typename TIntegerType<MemberType>::FType;
+
+        template <typename FieldType>
+        static void NetSerialize(FArchive& Ar, MemberType& Value, const FieldType& Field) {
+            if (!Field.bHasRange || Field.Max <= Field.Min) {
+                IntegerType RawValue = static_cast<IntegerType>(Value);
+                Ar << RawValue;
+                Value = static_cast<MemberType>(RawValue);
+                return;
+            }
+
+            const int64 Min = static_cast<int64>(Field.Min);
+            const int64 Max = static_cast<int64>(Field.Max);
+
+            uint32 Step = Ar.IsSaving() ? static_cast<uint32>(FMath::Clamp(static_cast<int64>(Value), Min, Max) - Min) : 0;
+            Ar.SerializeInt(Step, static_cast<uint32>(FMath::Min<int64>(Max - Min + 1, TNumericLimits<uint32>::Max())));
+
+            if (Ar.IsLoading()) { Value = static_cast<MemberType>(Min + Step); }
+        }
+
+        template <typename FieldType>
+        static bool IsIdentical(MemberType Value, MemberType Other, const FieldType& Field) { return Value == Other; }
+
+        static void Interpolate(MemberType& Value, MemberType Other, double Alpha) { Value = Alpha < 0.5 ? Value : Other; }
+
+        template <typename FieldType>
+        static bool ShouldReconcile(MemberType Value, MemberType Other, const FieldType& Field) {
+            return FMath::Abs(static_cast<int64>(Value) - static_cast<int64>(Other)) > static_cast<int64>(Field.Tolerance);
+        }
+    };
+
+    template <typename ComponentType>
+    struct TSchemaFieldCodec<UE::Math::TVector<ComponentType>> {
+        using ComponentCodec = TSchemaFieldCodec<ComponentType>;
+
+        template <typename FieldType>
+        static void NetSerialize(FArchive& Ar, UE::Math::TVector<ComponentType>& Value, const FieldType& Field) {
+            ComponentCodec::NetSerialize(Ar, Value.X, Field);
+            ComponentCodec::NetSerialize(Ar, Value.Y, Field);
+            ComponentCodec::NetSerialize(Ar, Value.Z, Field);
+        }
+
+        template <typename FieldType>
+        static bool IsIdentical(const UE::Math::TVector<ComponentType>& Value, const UE::Math::TVector<ComponentType>& Other, const FieldType& Field) {
+            return ComponentCodec::IsIdentical(Value.X, Other.X, Field) && ComponentCodec::IsIdentical(Value.Y, Other.Y, Field) &&
+                ComponentCodec::IsIdentical(Value.Z, Other.Z, Field);
+        }
+
+        static void Interpolate(UE::Math::TVector<ComponentType>& Value, const UE::Math::TVector<ComponentType>& Other, double Alpha) {
+            Value = FMath::Lerp(Value, Other, static_cast<ComponentType>(Alpha));
+        }
+
+        template <typename FieldType>
+        static bool ShouldReconcile(const UE::Math::TVector<ComponentType>& Value, const UE::Math::TVector<ComponentType>& Other, const FieldType& Field) {
+            const UE::Math::TVector<double> Delta(Field.SentValue(Value.X) - Field.SentValue(Other.X), Field.SentValue(Value.Y) - Field.SentValue(Other.Y),
+                                                  Field.SentValue(Value.Z) - Field.SentValue(Other.Z));
+            return Delta.Size() > Field.Tolerance;
+        }
+    };
+
+    template <typename ObjectType, typename MemberType>
+    void TSchemaField<ObjectType, MemberType>::NetSerialize(FArchive& Ar, ObjectType& Object) const {
+        TSchemaFieldCodec<MemberType>::NetSerialize(Ar, Object.*Member, *this);
+    }
+
+    template <typename ObjectType, typename MemberType>
+    bool TSchemaField<ObjectType, MemberType>::IsIdentical(const ObjectType& Object, const ObjectType& Other) const {
+        return TSchemaFieldCodec<MemberType>::IsIdentical(Object.*Member, Other.*Member, *this);
+    }
+
+    template <typename ObjectType, typename MemberType>
+    void TSchemaField<ObjectType, MemberType>::Interpolate(ObjectType& Object, const ObjectType& Other, double Alpha) const {
+        TSchemaFieldCodec<MemberType>::Interpolate(Object.*Member, Other.*Member, Alpha);
+    }
+
+    template <typename ObjectType, typename MemberType>
+    bool TSchemaField<ObjectType, MemberType>::ShouldReconcile(const ObjectType& Object, const ObjectType& Other) const {
+        return TSchemaFieldCodec<MemberType>::ShouldReconcile(Object.*Member, Other.*Member, *this);
+    }
+
+    /**
+     * A list of fields that replaces the hand written NetSerialize, Interpolate and ShouldReconcile of a state or input. Declare it on the type after its
+     * members, for example:
+     *
+     * static constexpr auto kSchema = MakeSchema(Field(&FMyState::Speed).WithRange(-2000.0, 2000.0).WithPrecision(0.01).WithTolerance(0.5),
+     *                                            Field(&FMyState::bIsGrounded));
+     *
+     * Sim proxy states are then sent with a change mask against the previous state, so only the fields that changed are written.
+     */
+    template <typename... FieldTypes>
+    struct TSchema {
+        std::tuple<FieldTypes...> Fields;
+
+        template <typename ObjectType>
+        void NetSerialize(ObjectType& Object, FArchive& Ar, EDataCompleteness Completeness) const {
+            ForEachField([&](const auto& Field) {
+                if (Field.IsSent(Completeness)) { Field.NetSerialize(Ar, Object); }
+            });
+        }
+
+        /** Writes a bit per field that says whether it differs from Baseline, followed by the field if it does. */
+        template <typename ObjectType>
+        void NetSerializeDelta(ObjectType& Object, const ObjectType& Baseline, FArchive& Ar, EDataCompleteness Completeness) const {
+            ForEachField([&](const auto& Field) {
+                if (!Field.IsSent(Completeness)) { return; }
+
+                uint8 bChanged = Ar.IsSaving() && !Field.IsIdentical(Object, Baseline) ? 1 : 0;
+                Ar.SerializeBits(&bChanged, 1);
+
+                if (bChanged != 0) { Field.NetSerialize(Ar, Object); }
+                else if (Ar.IsLoading()) { Object.*(Field.Member) = Baseline.*(Field.Member); }
+            });
+        }
+
+        template <typename ObjectType>
+        bool IsIdentical(const ObjectType& Object, const ObjectType& Other, EDataCompleteness Completeness) const {
+            bool bIsIdentical = true;
+            ForEachField([&](const auto& Field) { bIsIdentical = bIsIdentical && (!Field.IsSent(Completeness) || Field.IsIdentical(Object, Other)); });
+
+            return bIsIdentical;
+        }
+
+        template <typename ObjectType>
+        void Interpolate(ObjectType& Object, const ObjectType& Other, double Alpha) const {
+            ForEachField([&](const auto& Field) { Field.Interpolate(Object, Other, Alpha); });
+        }
+
+        template <typename ObjectType>
+        bool ShouldReconcile(const ObjectType& Object, const ObjectType& Other) const {
+            bool bShouldReconcile = false;
+            ForEachField([&](const auto& Field) { bShouldReconcile = bShouldReconcile || Field.ShouldReconcile(Object, Other); });
+
+            return bShouldReconcile;
+        }
+
+    private:
+        template <typename Func>
+        void ForEachField(Func&& Callback) const {
+            std::apply([&](const auto&... Field) { (Callback(Field), ...); }, Fields);
+        }
+    };
+
+    template <typename... FieldTypes>
+    constexpr TSchema<FieldTypes...> MakeSchema(FieldTypes... Fields) {
+        return TSchema<FieldTypes...>{std::tuple<FieldTypes...>(Fields...)};
+    }
+
+    template <typename Type, typename = void>
+    struct THasSchema : std::false_type {};
+
+    template <typename Type>
+    struct THasSchema<Type, std::void_t<decltype(Type::kSchema)>> : std::true_type {};
+
+    /** Calls into the schema of a state or input if it declares one, otherwise into its hand written functions. */
+    template <typename Type>
+    struct TSchemaOps {
+        static void NetSerialize(Type& Object, FArchive& Ar, EDataCompleteness Completeness) {
+            if constexpr (THasSchema<Type>::value) { Type::kSchema.NetSerialize(Object, Ar, Completeness); }
+            else { Object.NetSerialize(Ar, Completeness); }
+        }
+
+        /** Inputs are always sent with full completeness. */
+        static void NetSerializeInput(Type& Object, FArchive& Ar) {
+            if constexpr (THasSchema<Type>::value) { Type::kSchema.NetSerialize(Object, Ar, EDataCompleteness::kFull); }
+            else { Object.NetSerialize(Ar); }
+        }
+
+        static void Interpolate(Type& Object, const Type& Other, double Alpha) {
+            if constexpr (THasSchema<Type>::value) { Type::kSchema.Interpolate(Object, Other, Alpha); }
+            else { Object.Interpolate(Other, Alpha); }
+        }
+
+        static bool ShouldReconcile(const Type& Object, const Type& Other) {
+            if constexpr (THasSchema<Type>::value) { return Type::kSchema.ShouldReconcile(Object, Other); }
+            else { return Object.ShouldReconcile(Other); }
+        }
+    };
+}
@@ -7,6 +7,7 @@
 #include "ClientPredictionDelegate.h"
 #include "ClientPredictionSimInput.h"
 #include "ClientPredictionSimProxy.h"
+#include "ClientPredictionSimScheduler.h"
 #include "ClientPredictionSimState.h"
 #include "ClientPredictionSimEvents.h"
 #include "ClientPredictionUtils.h"
@@ -19,20 +20,18 @@ namespace ClientPrediction {
         virtual void Initialize(UPrimitiveComponent* NewUpdatedComponent, ENetRole NewSimRole) = 0;
         virtual void Destroy() = 0;
 
-        virtual void ConsumeInputBundle(FBundledPackets Packets) = 0;
-        virtual void ConsumeSimProxyStates(FBundledPacketsLow Packets) = 0;
+        /** Called on the physics thread. Inputs from every sim a client controls arrive in one RPC, which is consumed in a single physics command. */
+        virtual void ConsumeInputWindowSize(uint8 WindowSize) = 0;
+        virtual void ConsumeInputLeadAdjustment(FInputLeadAdjustment Adjustment) = 0;
+        virtual void ConsumeSimProxyStates(FBundledPacketsDelta Packets) = 0;
         virtual void ConsumeAutoProxyStates(FBundledPacketsFull Packets) = 0;
         virtual void ConsumeFinalState(FBundledPacketsFull Packets) = 0;
 
         virtual void ConsumeEvents(FBundledPackets Packets) = 0;
-        virtual void ConsumeRemoteSimProxyOffset(FRemoteSimProxyOffset Offset) = 0;
-
-        DECLARE_DELEGATE_OneParam(FRemoteSimProxyOffsetChangedDelegate, const FRemoteSimProxyOffset& Offset)
-        FRemoteSimProxyOffsetChangedDelegate RemoteSimProxyOffsetChangedDelegate;
     };
 
     template <typename Traits>
-    class USimCoordinator : public USimCoordinatorBase, public Chaos::ISimCallbackObject {
+    class USimCoordinator : public USimCoordinatorBase {
     public:
         explicit USimCoordinator(const TSharedPtr<USimInput<Traits>>& SimInput, const TSharedPtr<USimState<Traits>>& SimState,
                                  const TSharedPtr<USimEvents>& SimEvents);
@@ -49,49 +48,48 @@ namespace ClientPrediction {
         virtual void Destroy() override;
 
     private:
-        void DestroyPT();
-        void DestroyGT();
+        // The scheduler for the world drives all of the physics callbacks below.
+        friend class TSimGroup<Traits>;
 
-        virtual void FreeOutputData_External(Chaos::FSimCallbackOutput* Output) override {}
-        virtual void FreeInputData_Internal(Chaos::FSimCallbackInput* Input) override {}
+        int32 TriggerRewindIfNeeded(const FWorldTickContext& Context);
 
-    private:
-        virtual Chaos::FSimCallbackInput* AllocateInputData_External() override { return nullptr; }
-        virtual void OnPreSimulate_Internal() override {}
-        virtual int32 TriggerRewindIfNeeded_Internal(int32 LastCompletedTick) override;
+        void InjectInputsGT();
+        void PreAdvance(const int32 TickNum, const FWorldTickContext& Context);
+        void PostAdvance(const FWorldTickContext& Context);
+        void PostTickGT(const FWorldTickContext& Context);
 
-        void InjectInputsGT(const int32 StartTick, const int32 NumTicks);
-        void PreAdvance(const int32 TickNum);
-        void PostAdvance(Chaos::FReal Dt);
-        void OnPhysScenePostTick(FChaosScene* Scene);
+        // PreAdvance and PostAdvance are split into phases so that the scheduler can run the ones that only work on the sim's own data (input lookup and
+        // state building) in parallel, while every change to the physics body is made serially. A phase does nothing once an earlier one ended the tick.
+        void BeginPreAdvance(const int32 TickNum, const FWorldTickContext& Context);
+        void PreparePrePhysics();
+        void TickPrePhysics();
+        void TickPostPhysics(const FWorldTickContext& Context);
+        void RecordPostPhysics();
 
-        bool BuildTickInfo(FNetTickInfo& Info) const;
+        bool BuildTickInfo(FNetTickInfo& Info, const FWorldTickContext& Context);
+        Chaos::FRigidBodyHandle_Internal* GetPhysHandle();
 
-        FDelegateHandle InjectInputsGTDelegateHandle;
-        FDelegateHandle PreAdvanceDelegateHandle;
-        FDelegateHandle PostAdvanceDelegateHandle;
-        FDelegateHandle PhysScenePostTickDelegateHandle;
-        FDelegateHandle RemoteSimProxyOffsetChangedDelegateHandle;
+        // Called on the game thread whenever a component's physics state is created or destroyed, which replaces the body's actor handle.
+        void OnPhysicsStateChanged(UActorComponent* Component, bool bCreated);
+        void QueuePhysHandle(FPhysicsActorHandle ActorHandle);
 
         TAtomic<ESimStage> SimStage = ESimStage::kRunning;
-        TAtomic<bool> bDestroyedPT = false;
-        TAtomic<bool> bDestroyedGT = false;
+        bool bRegistered = false;
 
     public:
-        virtual void ConsumeInputBundle(FBundledPackets Packets) override;
-        virtual void ConsumeSimProxyStates(FBundledPacketsLow Packets) override;
+        virtual void ConsumeInputWindowSize(uint8 WindowSize) override;
+        virtual void ConsumeInputLeadAdjustment(FInputLeadAdjustment Adjustment) override;
+        virtual void ConsumeSimProxyStates(FBundledPacketsDelta Packets) override;
         virtual void ConsumeAutoProxyStates(FBundledPacketsFull Packets) override;
         virtual void ConsumeFinalState(FBundledPacketsFull Packets) override;
 
         virtual void ConsumeEvents(FBundledPackets Packets) override;
-        virtual void ConsumeRemoteSimProxyOffset(FRemoteSimProxyOffset Offset) override;
 
     private:
         UWorld* GetWorld() const;
         APlayerController* GetPlayerController() const;
         FPhysScene* GetPhysScene() const;
         Chaos::FPhysicsSolver* GetPhysSolver() const;
-        FNetworkPhysicsCallback* GetPhysCallback() const;
 
     public:
         TSharedPtr<FSimDelegates<Traits>> GetSimDelegates() { return SimDelegates; };
@@ -102,19 +100,34 @@ namespace ClientPrediction {
         class UPrimitiveComponent* UpdatedComponent = nullptr;
         ENetRole SimRole = ROLE_None;
 
+        // The connection that the remote sim proxy offsets on the authority come from. It changes if the sim is possessed by another player.
+        TWeakObjectPtr<const UNetConnection> RemoteSimProxyOffsetConnection;
+
+        FDelegateHandle CreatePhysicsHandle;
+        FDelegateHandle DestroyPhysicsHandle;
+
+        // Only accessed on the physics thread. The actor handle is looked up on the game thread and handed over through the scheduler's change queue, so the
+        // physics thread never reads the component's body instance.
+        FPhysicsActorHandle CachedActorHandle = nullptr;
+        Chaos::FRigidBodyHandle_Internal* CachedPhysHandle = nullptr;
+
         Chaos::FReal CachedSolverTime = -1.0;
         int32 CachedTickNumber = INDEX_NONE;
+
+        // The tick info of the physics callback that is currently running, shared between its phases.
+        FNetTickInfo TickInfoPT{};
+        bool bTickingPT = false;
         int32 EarliestLocalTick = INDEX_NONE;
         Chaos::FReal LastResultsTime = -1.0;
 
-        FCriticalSection FinalStateMutex;
-        TOptional<FBundledPacketsFull> FinalStatePacket;
+        // Final states are received on the game thread and consumed on the physics thread.
+        TQueue<FBundledPacketsFull, EQueueMode::Spsc> FinalStatePackets;
     };
 
     template <typename Traits>
     USimCoordinator<Traits>::USimCoordinator(const TSharedPtr<USimInput<Traits>>& SimInput, const TSharedPtr<USimState<Traits>>& SimState,
                                              const TSharedPtr<USimEvents>& SimEvents) :
-        Chaos::ISimCallbackObject(Chaos::ESimCallbackOptions::Rewind), SimInput(SimInput), SimState(SimState), SimEvents(SimEvents),
+        SimInput(SimInput), SimState(SimState), SimEvents(SimEvents),
         SimDelegates(MakeShared<FSimDelegates<Traits>>(SimEvents)) {
         SimInput->SetSimDelegates(SimDelegates);
         SimState->SetSimDelegates(SimDelegates);
@@ -128,88 +141,54 @@ namespace ClientPrediction {
         UpdatedComponent = NewUpdatedComponent;
         SimRole = NewSimRole;
 
-        FPhysScene* PhysScene = GetPhysScene();
-        if (PhysScene == nullptr) { return; }
-
         Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
         if (PhysSolver == nullptr) { return; }
 
         Chaos::FRewindData* RewindData = PhysSolver->GetRewindData();
         if (RewindData == nullptr) { return; }
 
-        FNetworkPhysicsCallback* PhysCallback = GetPhysCallback();
-        if (PhysCallback == nullptr) { return; }
-
         AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
         if (SimProxyWorldManager == nullptr) { return; }
 
         SimInput->SetBufferSize(RewindData->Capacity());
-        SimState->SetBufferSize(RewindData->Capacity());
+        // Sim proxies only interpolate, so they just need to buffer enough states to cover the interpolation delay rather than the whole rewind window.
+        SimState->SetBufferSize(SimRole == ROLE_SimulatedProxy ? FMath::Min(RewindData->Capacity(), ClientPredictionSimProxyHistoryTicks) : RewindData->Capacity());
+        SimEvents->SetBufferSize(RewindData->Capacity());
         SimEvents->SetHistoryDuration(RewindData->Capacity() * PhysSolver->GetAsyncDeltaTime());
 
-        InjectInputsGTDelegateHandle = PhysCallback->InjectInputsExternal.AddRaw(this, &USimCoordinator::InjectInputsGT);
-        PreAdvanceDelegateHandle = PhysCallback->PreProcessInputsInternal.AddRaw(this, &USimCoordinator::PreAdvance);
-        PostAdvanceDelegateHandle = PhysSolver->AddPostAdvanceCallback(FSolverPostAdvance::FDelegate::CreateRaw(this, &USimCoordinator::PostAdvance));
-        PhysScenePostTickDelegateHandle = PhysScene->OnPhysScenePostTick.AddRaw(this, &USimCoordinator::OnPhysScenePostTick);
-        RemoteSimProxyOffsetChangedDelegateHandle = SimProxyWorldManager->RemoteSimProxyOffsetChangedDelegate.AddLambda([this](const auto& Offset) {
-            if (Offset.IsSet() && SimRole == ROLE_AutonomousProxy) { RemoteSimProxyOffsetChangedDelegate.ExecuteIfBound(Offset.GetValue()); }
-        });
+        SimProxyWorldManager->GetScheduler().Register(this);
+        bRegistered = true;
 
-        PhysCallback->RegisterRewindableSimCallback_Internal(this);
+        const FBodyInstance* BodyInstance = UpdatedComponent != nullptr ? UpdatedComponent->GetBodyInstance() : nullptr;
+        QueuePhysHandle(BodyInstance != nullptr ? BodyInstance->GetPhysicsActorHandle() : nullptr);
 
-        const TOptional<FRemoteSimProxyOffset>& RemoteSimProxyOffset = SimProxyWorldManager->GetRemoteSimProxyOffset();
-        if (SimRole == ENetRole::ROLE_AutonomousProxy && RemoteSimProxyOffset.IsSet()) {
-            RemoteSimProxyOffsetChangedDelegate.ExecuteIfBound(RemoteSimProxyOffset.GetValue());
-        }
+        CreatePhysicsHandle = UActorComponent::GlobalCreatePhysicsDelegate.AddLambda([this](UActorComponent* Component) {
+            OnPhysicsStateChanged(Component, true);
+        });
+        DestroyPhysicsHandle = UActorComponent::GlobalDestroyPhysicsDelegate.AddLambda([this](UActorComponent* Component) {
+            OnPhysicsStateChanged(Component, false);
+        });
     }
 
     template <typename Traits>
     void USimCoordinator<Traits>::Destroy() {
-        DestroyPT();
-        DestroyGT();
-    }
-
-    template <typename Traits>
-    void USimCoordinator<Traits>::DestroyPT() {
-        if (bDestroyedPT.Exchange(true)) { return; }
-
-        FPhysScene* PhysScene = GetPhysScene();
-        if (PhysScene == nullptr) { return; }
-
-        Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
-        if (PhysSolver == nullptr) { return; }
+        if (!bRegistered) { return; }
+        bRegistered = false;
 
-        FNetworkPhysicsCallback* PhysCallback = GetPhysCallback();
-        if (PhysCallback == nullptr) { return; }
+        UActorComponent::GlobalCreatePhysicsDelegate.Remove(CreatePhysicsHandle);
+        UActorComponent::GlobalDestroyPhysicsDelegate.Remove(DestroyPhysicsHandle);
 
         AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
         if (SimProxyWorldManager == nullptr) { return; }
 
-        PhysCallback->InjectInputsExternal.Remove(InjectInputsGTDelegateHandle);
-        PhysCallback->PreProcessInputsInternal.Remove(PreAdvanceDelegateHandle);
-        PhysSolver->RemovePostAdvanceCallback(PostAdvanceDelegateHandle);
-
-        PhysCallback->UnregisterRewindableSimCallback_Internal(this);
-    }
-
-    template <typename Traits>
-    void USimCoordinator<Traits>::DestroyGT() {
-        if (bDestroyedGT.Exchange(true)) { return; }
-
-        FPhysScene* PhysScene = GetPhysScene();
-        if (PhysScene == nullptr) { return; }
-
-        PhysScene->OnPhysScenePostTick.Remove(PhysScenePostTickDelegateHandle);
+        SimProxyWorldManager->GetScheduler().Unregister(this);
     }
 
     template <typename Traits>
-    int32 USimCoordinator<Traits>::TriggerRewindIfNeeded_Internal(int32 LastCompletedTick) {
+    int32 USimCoordinator<Traits>::TriggerRewindIfNeeded(const FWorldTickContext& Context) {
         if (UpdatedComponent == nullptr || SimState == nullptr || SimEvents == nullptr || SimRole != ROLE_AutonomousProxy) { return INDEX_NONE; }
 
-        Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
-        if (PhysSolver == nullptr) { return false; }
-
-        const int32 RewindTick = SimState->GetRewindTick(PhysSolver, UpdatedComponent->GetPhysicsObjectByName(NAME_None));
+        const int32 RewindTick = SimState->GetRewindTick(Context.PhysSolver, UpdatedComponent->GetPhysicsObjectByName(NAME_None));
         if (RewindTick != INDEX_NONE) {
             SimEvents->Rewind(RewindTick);
         }
@@ -218,94 +197,123 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::InjectInputsGT(const int32 StartTick, const int32 NumTicks) {
+    void USimCoordinator<Traits>::InjectInputsGT() {
         if (SimInput != nullptr && SimStage == ESimStage::kRunning) {
             SimInput->InjectInputsGT();
         }
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::PreAdvance(const int32 TickNum) {
-        if (SimInput == nullptr || SimState == nullptr || SimEvents == nullptr) { return; }
+    void USimCoordinator<Traits>::PreAdvance(const int32 TickNum, const FWorldTickContext& Context) {
+        BeginPreAdvance(TickNum, Context);
+        PreparePrePhysics();
+        TickPrePhysics();
+    }
 
-        Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
-        if (PhysSolver == nullptr) { return; }
+    template <typename Traits>
+    void USimCoordinator<Traits>::PostAdvance(const FWorldTickContext& Context) {
+        TickPostPhysics(Context);
+        RecordPostPhysics();
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::BeginPreAdvance(const int32 TickNum, const FWorldTickContext& Context) {
+        bTickingPT = false;
+        if (SimInput == nullptr || SimState == nullptr || SimEvents == nullptr || SimStage == ESimStage::kReadyForCleanup) { return; }
 
         // Avoid simulating before the object was actually being simulated. This can happen if something rewinds physics before EarliestLocalTick
         EarliestLocalTick = EarliestLocalTick == INDEX_NONE ? TickNum : EarliestLocalTick;
         if (TickNum < EarliestLocalTick) { return; }
 
         CachedTickNumber = TickNum;
-        CachedSolverTime = PhysSolver->GetSolverTime();
+        CachedSolverTime = Context.SolverTime;
+
+        if (!BuildTickInfo(TickInfoPT, Context)) { return; }
 
-        FNetTickInfo TickInfo{};
-        if (!BuildTickInfo(TickInfo)) { return; }
+        // Corrections are applied first so that the input and state prepared for this tick see the corrected body.
+        SimState->ApplyCorrectionIfNeeded(TickInfoPT);
+        bTickingPT = true;
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::PreparePrePhysics() {
+        if (!bTickingPT) { return; }
 
         if (SimRole != ROLE_Authority) {
-            FScopeLock FinalStateLock(&FinalStateMutex);
-            if (FinalStatePacket.IsSet()) {
-                SimState->ConsumeFinalState(FinalStatePacket.GetValue(), TickInfo);
-                FinalStatePacket.Reset();
+            FBundledPacketsFull FinalStatePacket{};
+            while (FinalStatePackets.Dequeue(FinalStatePacket)) {
+                SimState->ConsumeFinalState(FinalStatePacket, TickInfoPT);
             }
         }
 
         // State needs to come before the input because the input depends on the current state. If the simulation is over we don't need to prepare input anymore.
-        SimStage = SimState->PreparePrePhysics(TickInfo);
-
+        SimStage = SimState->PreparePrePhysics(TickInfoPT);
         if (SimStage == ESimStage::kReadyForCleanup) {
-            DestroyPT();
+            bTickingPT = false;
             return;
         }
 
         if (SimStage == ESimStage::kRunning) {
-            SimInput->PreparePrePhysics(TickInfo, SimState->GetPrevState());
+            SimInput->PreparePrePhysics(TickInfoPT, SimState->GetPrevState());
         }
 
-        SimEvents->PreparePrePhysics(TickInfo);
-        SimState->TickPrePhysics(TickInfo, SimInput->GetCurrentInput());
+        SimEvents->PreparePrePhysics(TickInfoPT);
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::PostAdvance(Chaos::FReal Dt) {
-        if (SimInput == nullptr || SimState == nullptr) { return; }
+    void USimCoordinator<Traits>::TickPrePhysics() {
+        if (!bTickingPT) { return; }
+        SimState->TickPrePhysics(TickInfoPT, SimInput->GetCurrentInput());
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::TickPostPhysics(const FWorldTickContext& Context) {
+        bTickingPT = false;
+        if (SimInput == nullptr || SimState == nullptr || SimStage == ESimStage::kReadyForCleanup) { return; }
 
         // Avoid simulating before the object was actually being simulated. This can happen if something rewinds physics before EarliestLocalTick
         if (EarliestLocalTick == INDEX_NONE || CachedTickNumber < EarliestLocalTick) {
             return;
         }
 
-        FNetTickInfo TickInfo{};
-        if (!BuildTickInfo(TickInfo)) { return; }
+        if (!BuildTickInfo(TickInfoPT, Context)) { return; }
 
-        SimState->TickPostPhysics(TickInfo, SimInput->GetCurrentInput());
+        bTickingPT = SimState->TickPostPhysics(TickInfoPT, SimInput->GetCurrentInput());
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::OnPhysScenePostTick(FChaosScene* Scene) {
-        if (SimInput == nullptr || SimState == nullptr || SimEvents == nullptr || EarliestLocalTick == INDEX_NONE) { return; }
-
-        if (SimStage == ESimStage::kReadyForCleanup) {
-            DestroyGT();
-            return;
-        }
+    void USimCoordinator<Traits>::RecordPostPhysics() {
+        if (!bTickingPT) { return; }
+        SimState->RecordPostPhysics(TickInfoPT);
+    }
 
-        Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
-        if (PhysSolver == nullptr) { return; }
+    template <typename Traits>
+    void USimCoordinator<Traits>::PostTickGT(const FWorldTickContext& Context) {
+        if (SimInput == nullptr || SimState == nullptr || SimEvents == nullptr || EarliestLocalTick == INDEX_NONE) { return; }
 
-        AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
-        if (SimProxyWorldManager == nullptr) { return; }
+        // Once the simulation is over there is nothing left to tick, the scheduler drops the coordinator when the component destroys it.
+        if (SimStage == ESimStage::kReadyForCleanup) { return; }
 
         if (SimRole == ENetRole::ROLE_AutonomousProxy) {
             SimInput->EmitInputs();
         }
 
         if (SimRole == ENetRole::ROLE_Authority) {
+            const AActor* OwnerActor = UpdatedComponent->GetOwner();
+            const UNetConnection* Connection = OwnerActor != nullptr ? OwnerActor->GetNetConnection() : nullptr;
+
+            if (Connection != RemoteSimProxyOffsetConnection.Get()) {
+                RemoteSimProxyOffsetConnection = Connection;
+                SimEvents->SetRemoteSimProxyOffsets(Context.SimProxyWorldManager->GetRemoteSimProxyOffsets(Connection));
+            }
+
+            SimInput->EmitInputFeedback();
             SimState->EmitStates();
             SimEvents->EmitEvents();
         }
 
-        const Chaos::FReal ResultsTime = PhysSolver->GetPhysicsResultsTime_External();
-        const Chaos::FReal SimProxyOffset = SimProxyWorldManager->GetLocalToServerOffset() * PhysSolver->GetAsyncDeltaTime();
+        const Chaos::FReal ResultsTime = Context.PhysSolver->GetPhysicsResultsTime_External();
+        const Chaos::FReal SimProxyOffset = Context.SimProxyWorldManager->GetLocalToServerOffset() * Context.Dt;
         const Chaos::FReal Dt = LastResultsTime == -1.0 ? 0.0 : ResultsTime - LastResultsTime;
 
         SimState->InterpolateGameThread(UpdatedComponent, ResultsTime, SimProxyOffset, Dt, SimRole);
@@ -315,13 +323,10 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    bool USimCoordinator<Traits>::BuildTickInfo(FNetTickInfo& Info) const {
+    bool USimCoordinator<Traits>::BuildTickInfo(FNetTickInfo& Info, const FWorldTickContext& Context) {
         if (UpdatedComponent == nullptr) { return false; }
 
-        const UWorld* World = GetWorld();
-        if (World == nullptr) { return false; }
-
-        if (!FUtils::FillTickInfo(Info, CachedTickNumber, SimRole, World)) {
+        if (!FUtils::FillTickInfo(Info, CachedTickNumber, SimRole, Context)) {
             return false;
         }
 
@@ -331,26 +336,62 @@ namespace ClientPrediction {
         Info.EndTime = Info.StartTime + Info.Dt;
 
         Info.UpdatedComponent = UpdatedComponent;
-        Info.SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(World);
+        Info.PhysHandle = GetPhysHandle();
+        Info.SimProxyWorldManager = Context.SimProxyWorldManager;
         Info.SimRole = SimRole;
 
         return true;
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::ConsumeInputBundle(FBundledPackets Packets) {
-        if (UpdatedComponent == nullptr || SimInput == nullptr) { return; }
+    Chaos::FRigidBodyHandle_Internal* USimCoordinator<Traits>::GetPhysHandle() {
+        // The proxy only gets its physics thread handle once the solver has picked up the new body, so it is resolved lazily from the proxy itself.
+        if (CachedPhysHandle == nullptr && CachedActorHandle != nullptr) {
+            CachedPhysHandle = CachedActorHandle->GetPhysicsThreadAPI();
+        }
 
-        FPhysScene* PhysScene = GetPhysScene();
-        if (PhysScene == nullptr) { return; }
+        return CachedPhysHandle;
+    }
 
-        PhysScene->EnqueueAsyncPhysicsCommand(0, UpdatedComponent, [this, Packets = MoveTemp(Packets)]() {
-            SimInput->ConsumeInputBundle(Packets);
+    template <typename Traits>
+    void USimCoordinator<Traits>::OnPhysicsStateChanged(UActorComponent* Component, const bool bCreated) {
+        if (Component == nullptr || Component != UpdatedComponent) { return; }
+
+        // The destroy delegate is broadcast before the body is torn down, so the physics thread drops the handle before the solver removes the proxy.
+        const FBodyInstance* BodyInstance = bCreated ? UpdatedComponent->GetBodyInstance() : nullptr;
+        QueuePhysHandle(BodyInstance != nullptr ? BodyInstance->GetPhysicsActorHandle() : nullptr);
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::QueuePhysHandle(FPhysicsActorHandle ActorHandle) {
+        AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
+        if (SimProxyWorldManager == nullptr) { return; }
+
+        // Retiring the coordinator goes through the same queue, so the coordinator is still alive when this runs.
+        SimProxyWorldManager->GetScheduler().QueueChangePT([this, ActorHandle]() {
+            CachedActorHandle = ActorHandle;
+            CachedPhysHandle = nullptr;
         });
     }
 
     template <typename Traits>
-    void USimCoordinator<Traits>::ConsumeSimProxyStates(FBundledPacketsLow Packets) {
+    void USimCoordinator<Traits>::ConsumeInputWindowSize(uint8 WindowSize) {
+        if (SimInput == nullptr || SimRole != ROLE_AutonomousProxy) { return; }
+        SimInput->SetSendWindowSize(WindowSize);
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::ConsumeInputLeadAdjustment(FInputLeadAdjustment Adjustment) {
+        if (SimRole != ROLE_AutonomousProxy) { return; }
+
+        // The lead is shared by every autonomous proxy in the world, so this goes to the manager rather than the sim.
+        if (AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld())) {
+            SimProxyWorldManager->AdjustInputLead(Adjustment);
+        }
+    }
+
+    template <typename Traits>
+    void USimCoordinator<Traits>::ConsumeSimProxyStates(FBundledPacketsDelta Packets) {
         if (UpdatedComponent == nullptr || SimState == nullptr || SimRole != ROLE_SimulatedProxy) { return; }
 
         FPhysScene* PhysScene = GetPhysScene();
@@ -377,8 +418,7 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimCoordinator<Traits>::ConsumeFinalState(FBundledPacketsFull Packets) {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        FinalStatePacket = MoveTemp(Packets);
+        FinalStatePackets.Enqueue(MoveTemp(Packets));
     }
 
     template <typename Traits>
@@ -396,16 +436,6 @@ namespace ClientPrediction {
         });
     }
 
-    template <typename Traits>
-    void USimCoordinator<Traits>::ConsumeRemoteSimProxyOffset(FRemoteSimProxyOffset Offset) {
-        FPhysScene* PhysScene = GetPhysScene();
-        if (PhysScene == nullptr) { return; }
-
-        PhysScene->EnqueueAsyncPhysicsCommand(0, UpdatedComponent, [this, Offset = MoveTemp(Offset)]() {
-            SimEvents->ConsumeRemoteSimProxyOffset(Offset);
-        });
-    }
-
     template <typename Traits>
     UWorld* USimCoordinator<Traits>::GetWorld() const {
         if (UpdatedComponent == nullptr) { return nullptr; }
@@ -435,15 +465,4 @@ namespace ClientPrediction {
 
         return PhysScene->GetSolver();
     }
-
-    template <typename Traits>
-    FNetworkPhysicsCallback* USimCoordinator<Traits>::GetPhysCallback() const {
-        Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
-        if (PhysSolver == nullptr) { return nullptr; }
-
-        Chaos::IRewindCallback* RewindCallback = PhysSolver->GetRewindCallback();
-        if (RewindCallback == nullptr) { return nullptr; }
-
-        return static_cast<FNetworkPhysicsCallback*>(PhysSolver->GetRewindCallback());
-    }
 }
@@ -1,9 +1,12 @@
 ﻿#pragma once
 
 #include "CoreMinimal.h"
+#include "Containers/StaticArray.h"
+#include "ClientPredictionCVars.h"
 #include "ClientPredictionNetSerialization.h"
 #include "ClientPredictionSimProxy.h"
 #include "ClientPredictionTick.h"
+#include "ClientPredictionTickHistory.h"
 
 // For now events are ONLY predicted on auto proxies and replicated on sim proxies. In the future we might need to change this
 // so that the server can inform an auto proxy has executed event it mispredicted. It might also make sense to be able to rewind events as well.
@@ -11,6 +14,44 @@
 namespace ClientPrediction {
     using EventId = uint8;
 
+    /** How the authority sends events of a type to sim proxies. */
+    enum class EEventDelivery : uint8 {
+        /** Sent once over a reliable RPC. */
+        kReliable,
+
+        /**
+         * Sent over an unreliable RPC in cp.UnreliableEventRedundancy consecutive frames, and dropped if none of them arrive. Suited to cosmetic events,
+         * which shouldn't wait behind the reliable backlog of a lossy connection.
+         */
+        kUnreliable
+    };
+
+    /** A set of event ids, with one bit for every possible id. */
+    struct FEventIdMask {
+        void Add(EventId Id) { Words[Id >> 6] |= 1ull << (Id & 63); }
+        void Remove(EventId Id) { Words[Id >> 6] &= ~(1ull << (Id & 63)); }
+
+        /** Calls the callback for every id in the set. The callback can add and remove ids, but the ones it adds aren't necessarily visited. */
+        template <typename CallbackType>
+        void ForEach(CallbackType&& Callback) const;
+
+    private:
+        static constexpr int32 kNumWords = 256 / 64;
+        uint64 Words[kNumWords]{};
+    };
+
+    template <typename CallbackType>
+    void FEventIdMask::ForEach(CallbackType&& Callback) const {
+        for (int32 WordIdx = 0; WordIdx < kNumWords; ++WordIdx) {
+            for (uint64 Word = Words[WordIdx]; Word != 0; Word &= Word - 1) {
+                Callback(static_cast<EventId>(WordIdx * 64 + FMath::CountTrailingZeros64(Word)));
+            }
+        }
+    }
+
+    struct FEventFactoryBase;
+    using FEventFactoryTable = TStaticArray<TUniquePtr<FEventFactoryBase>, 256>;
+
     struct FEventIds {
         inline static EventId kNextEventId = 0;
 
@@ -47,10 +88,13 @@ namespace ClientPrediction {
         TMulticastDelegate<void(const EventType&, Chaos::FReal)>* Delegate = nullptr;
         EventType Event{};
 
-        int32 LocalTick = INDEX_NONE;
         int32 ServerTick = INDEX_NONE;
 
-        Chaos::FReal ExecutionTime = 0.0;
+        // Unreliable events are sent several times. Together with the server tick this identifies an event, so that sim proxies only execute it once.
+        EEventDelivery Delivery = EEventDelivery::kReliable;
+        uint8 Sequence = 0;
+        int32 SendsRemaining = 0;
+
         Chaos::FReal TimeSincePredicted = 0.0;
 
         bool bHasExecuted = false;
@@ -71,62 +115,128 @@ namespace ClientPrediction {
     void FEventWrapper<EventType>::NetSerialize(FArchive& Ar) {
         // EventId is not serialized here because when deserializing it from the authority a factory needs to create this object first.
         Ar << ServerTick;
+        if (Delivery == EEventDelivery::kUnreliable) { Ar << Sequence; }
 
         Event.NetSerialize(Ar);
     }
 
     struct FEventFactoryBase {
         virtual ~FEventFactoryBase() = default;
+        virtual void SetBufferSize(int32 BufferSize) = 0;
+
         virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) = 0;
         virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt) = 0;
 
         virtual void ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) = 0;
         virtual void Rewind(int32 LocalRewindTick) = 0;
         virtual int32 EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) = 0;
+        virtual EEventDelivery GetDelivery() const = 0;
+
+        /** Whether the factory holds any events, executed or not. Factories without events are skipped until a new one is created. */
+        virtual bool HasEvents() const = 0;
+        virtual bool HasEventsToEmit() const = 0;
     };
 
     template <typename EventType>
     struct FEventFactory : public FEventFactoryBase {
         using WrappedEvent = FEventWrapper<EventType>;
 
-        FEventFactory(int32 EventId) : EventId(EventId) {}
+        /** The events of a single tick. They all execute at the same time, in the order they were created. */
+        struct FTickEvents {
+            TArray<WrappedEvent> Events;
+            Chaos::FReal ExecutionTime = 0.0;
+        };
+
+        FEventFactory(int32 EventId, EEventDelivery Delivery) : EventId(EventId), Delivery(Delivery) {}
+        virtual void SetBufferSize(int32 BufferSize) override;
+
         virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) override;
         virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt) override;
 
         virtual void ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) override;
         virtual void Rewind(int32 LocalRewindTick) override;
         virtual int32 EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) override;
+        virtual EEventDelivery GetDelivery() const override { return Delivery; }
+
+        virtual bool HasEvents() const override { return NextExecuteTick != kNoTick || NextPruneTick != kNoTick; }
+        virtual bool HasEventsToEmit() const override { return NextEmitTick != kNoTick; }
 
         TMulticastDelegate<void(const EventType&, Chaos::FReal)> Delegate;
         int32 EventId = INDEX_NONE;
+        EEventDelivery Delivery = EEventDelivery::kReliable;
+
+    private:
+        static constexpr int32 kNoTick = TNumericLimits<int32>::Max();
 
-        TArray<WrappedEvent> Events;
+        FTickEvents* FindOrAddTick(int32 Tick, Chaos::FReal ExecutionTime);
+        void PruneHistory(Chaos::FReal HistoryStartTime);
+
+        // Events that are dispatched locally are keyed by their local tick and events received from the authority by their server tick. Later ticks always
+        // execute later, so the history is also the execution queue. Ticks that are pruned from it are refused, which also drops late copies of unreliable events.
+        TTickHistory<FTickEvents> TickEvents;
+
+        // No tick before these has events that still need to be executed or emitted. These keep every pass proportional to the ticks that have work.
+        int32 NextExecuteTick = kNoTick;
+        int32 NextEmitTick = kNoTick;
+        int32 NextPruneTick = kNoTick;
     };
 
+    template <typename EventType>
+    void FEventFactory<EventType>::SetBufferSize(int32 BufferSize) {
+        TickEvents.SetCapacity(FMath::Max(BufferSize, 1));
+
+        NextExecuteTick = kNoTick;
+        NextEmitTick = kNoTick;
+        NextPruneTick = kNoTick;
+    }
+
+    template <typename EventType>
+    typename FEventFactory<EventType>::FTickEvents* FEventFactory<EventType>::FindOrAddTick(int32 Tick, Chaos::FReal ExecutionTime) {
+        FTickEvents* Found = TickEvents.Find(Tick);
+        if (Found == nullptr) {
+            Found = TickEvents.Set(Tick, FTickEvents{});
+            if (Found == nullptr) { return nullptr; }
+        }
+
+        Found->ExecutionTime = ExecutionTime;
+
+        NextExecuteTick = FMath::Min(NextExecuteTick, Tick);
+        NextEmitTick = FMath::Min(NextEmitTick, Tick);
+        NextPruneTick = FMath::Min(NextPruneTick, Tick);
+
+        return Found;
+    }
+
     template <typename EventType>
     void FEventFactory<EventType>::CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) {
         // We check for duplicate events that have already been emitted so that during resims we don't get a bunch of duplicate
         // events all firing off.
         const EventType& EventData = *static_cast<const EventType*>(Data);
-        for (WrappedEvent& Event : Events) {
-            if (!Event.bHasExecuted || TickInfo.LocalTick != Event.LocalTick) { continue; }
-            if (Event.Event.NetIdentical(EventData)) {
-                return;
+        if (const FTickEvents* ExistingEvents = TickEvents.Find(TickInfo.LocalTick)) {
+            for (const WrappedEvent& Event : ExistingEvents->Events) {
+                if (Event.bHasExecuted && Event.Event.NetIdentical(EventData)) {
+                    return;
+                }
             }
         }
 
+        FTickEvents* NewTickEvents = FindOrAddTick(TickInfo.LocalTick, TickInfo.StartTime);
+        if (NewTickEvents == nullptr) { return; }
+
         WrappedEvent NewEvent{};
         NewEvent.EventId = EventId;
-        NewEvent.LocalTick = TickInfo.LocalTick;
         NewEvent.ServerTick = TickInfo.ServerTick;
 
-        NewEvent.ExecutionTime = TickInfo.StartTime;
+        NewEvent.Delivery = Delivery;
+        NewEvent.Sequence = static_cast<uint8>(NewTickEvents->Events.Num());
+        NewEvent.SendsRemaining = Delivery == EEventDelivery::kUnreliable ? FMath::Max(ClientPredictionUnreliableEventRedundancy, 1) : 0;
+
         NewEvent.TimeSincePredicted = FMath::Abs(static_cast<Chaos::FReal>(FMath::Min(RemoteSimProxyOffset, 0)) * TickInfo.Dt);
 
         NewEvent.Delegate = &Delegate;
         NewEvent.Event = EventData;
 
-        Events.Emplace(MoveTemp(NewEvent));
+        NewTickEvents->Events.Emplace(MoveTemp(NewEvent));
     }
 
     template <typename EventType>
@@ -134,57 +244,104 @@ namespace ClientPrediction {
         WrappedEvent NewEvent{};
         NewEvent.EventId = EventId;
         NewEvent.Delegate = &Delegate;
+        NewEvent.Delivery = Delivery;
 
         NewEvent.NetSerialize(Ar);
-        NewEvent.ExecutionTime = static_cast<Chaos::FReal>(NewEvent.ServerTick) * SimDt;
 
-        // We don't need to check for duplicate events here because the authority sends them reliably.
-        Events.Emplace(MoveTemp(NewEvent));
+        // Reliable events arrive exactly once, but unreliable ones are sent several times and any number of the copies can arrive.
+        if (Delivery == EEventDelivery::kUnreliable) {
+            if (const FTickEvents* ExistingEvents = TickEvents.Find(NewEvent.ServerTick)) {
+                for (const WrappedEvent& Event : ExistingEvents->Events) {
+                    if (Event.Sequence == NewEvent.Sequence) { return; }
+                }
+            }
+        }
+
+        FTickEvents* NewTickEvents = FindOrAddTick(NewEvent.ServerTick, static_cast<Chaos::FReal>(NewEvent.ServerTick) * SimDt);
+        if (NewTickEvents == nullptr) { return; }
+
+        NewTickEvents->Events.Emplace(MoveTemp(NewEvent));
     }
 
     template <typename EventType>
     void FEventFactory<EventType>::ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) {
         const Chaos::FReal AdjustedResultsTime = SimRole != ROLE_SimulatedProxy ? ResultsTime : ResultsTime + SimProxyOffset;
-        const Chaos::FReal HistoryStartTime = AdjustedResultsTime - HistoryDuration;
 
-        for (WrappedEvent& Event : Events) {
-            if (AdjustedResultsTime < Event.ExecutionTime || Event.bHasExecuted) {
-                continue;
-            }
+        if (NextExecuteTick != kNoTick && !TickEvents.IsEmpty()) {
+            int32 Tick = FMath::Max(NextExecuteTick, TickEvents.OldestTick());
+            NextExecuteTick = kNoTick;
 
-            Event.Execute();
-        }
+            for (; Tick <= TickEvents.NewestTick(); ++Tick) {
+                FTickEvents* Found = TickEvents.Find(Tick);
+                if (Found == nullptr) { continue; }
 
-        for (int32 EventIdx = 0; EventIdx < Events.Num();) {
-            if (Events[EventIdx].ExecutionTime < HistoryStartTime && Events[EventIdx].bHasExecuted) {
-                Events.RemoveAt(EventIdx);
-                continue;
+                if (AdjustedResultsTime < Found->ExecutionTime) {
+                    NextExecuteTick = Tick;
+                    break;
+                }
+
+                for (WrappedEvent& Event : Found->Events) {
+                    if (!Event.bHasExecuted) { Event.Execute(); }
+                }
             }
+        }
+
+        PruneHistory(AdjustedResultsTime - HistoryDuration);
+    }
+
+    template <typename EventType>
+    void FEventFactory<EventType>::PruneHistory(Chaos::FReal HistoryStartTime) {
+        if (NextPruneTick == kNoTick || TickEvents.IsEmpty()) { return; }
+
+        int32 Tick = INDEX_NONE;
+        while (FTickEvents* Oldest = TickEvents.FindAtOrAfter(FMath::Max(NextPruneTick, TickEvents.OldestTick()), &Tick)) {
+            // The oldest tick is remembered so that the gap before it isn't searched again every frame.
+            NextPruneTick = Tick;
+            if (Tick >= NextExecuteTick || Oldest->ExecutionTime >= HistoryStartTime) { return; }
 
-            ++EventIdx;
+            Oldest->Events.Reset();
+            TickEvents.RemoveBefore(Tick + 1);
         }
+
+        NextPruneTick = kNoTick;
     }
 
     template <typename EventType>
     void FEventFactory<EventType>::Rewind(int32 LocalRewindTick) {
-        for (int32 EventIdx = 0; EventIdx < Events.Num();) {
-            if (Events[EventIdx].LocalTick >= LocalRewindTick && !Events[EventIdx].bHasExecuted) {
-                Events.RemoveAt(EventIdx);
-                continue;
-            }
+        if (NextExecuteTick == kNoTick || TickEvents.IsEmpty()) { return; }
 
-            ++EventIdx;
+        // Only events that haven't executed yet are removed, and none of those are older than NextExecuteTick.
+        for (int32 Tick = FMath::Max3(LocalRewindTick, NextExecuteTick, TickEvents.OldestTick()); Tick <= TickEvents.NewestTick(); ++Tick) {
+            if (FTickEvents* Found = TickEvents.Find(Tick)) {
+                Found->Events.RemoveAll([](const WrappedEvent& Event) { return !Event.bHasExecuted; });
+            }
         }
     }
 
     template <typename EventType>
     int32 FEventFactory<EventType>::EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) {
         int32 NewestEvent = INDEX_NONE;
-
-        for (WrappedEvent& Event : Events) {
-            if (Event.ServerTick > LatestEmittedTick) {
-                NewestEvent = FMath::Max(Event.ServerTick, NewestEvent);
-                Serializers.Add(FEventSaver(Event));
+        if (NextEmitTick == kNoTick || TickEvents.IsEmpty()) { return NewestEvent; }
+
+        int32 Tick = FMath::Max(NextEmitTick, TickEvents.OldestTick());
+        NextEmitTick = kNoTick;
+
+        for (; Tick <= TickEvents.NewestTick(); ++Tick) {
+            FTickEvents* Found = TickEvents.Find(Tick);
+            if (Found == nullptr) { continue; }
+
+            for (WrappedEvent& Event : Found->Events) {
+                if (Delivery == EEventDelivery::kUnreliable) {
+                    if (Event.SendsRemaining <= 0) { continue; }
+
+                    // Unreliable events are sent again next frame, so this tick still has work.
+                    if (--Event.SendsRemaining > 0) { NextEmitTick = FMath::Min(NextEmitTick, Tick); }
+                    Serializers.Add(FEventSaver(Event));
+                }
+                else if (Event.ServerTick > LatestEmittedTick) {
+                    NewestEvent = FMath::Max(Event.ServerTick, NewestEvent);
+                    Serializers.Add(FEventSaver(Event));
+                }
             }
         }
 
@@ -192,7 +349,8 @@ namespace ClientPrediction {
     }
 
     struct FEventLoaderUserdata {
-        const TMap<EventId, TUniquePtr<FEventFactoryBase>>& Factories;
+        const FEventFactoryTable& Factories;
+        FEventIdMask& ActiveFactories;
         Chaos::FReal SimDt;
     };
 
@@ -206,22 +364,24 @@ namespace ClientPrediction {
         EventId EventId;
         Ar << EventId;
 
-        check(Userdata.Factories.Contains(EventId));
+        check(Userdata.Factories[EventId] != nullptr);
         Userdata.Factories[EventId]->CreateEvent(Ar, Userdata.SimDt);
+        Userdata.ActiveFactories.Add(EventId);
     }
 
     class CLIENTPREDICTION_API USimEvents {
     public:
         void SetHistoryDuration(Chaos::FReal NewHistoryDuration) { HistoryDuration = NewHistoryDuration; }
+        void SetBufferSize(int32 NewBufferSize);
 
         template <typename EventType>
-        TMulticastDelegate<void(const EventType&, Chaos::FReal)>& RegisterEvent();
+        TMulticastDelegate<void(const EventType&, Chaos::FReal)>& RegisterEvent(EEventDelivery Delivery = EEventDelivery::kReliable);
 
         template <typename Event>
         void DispatchEvent(const FNetTickInfo& TickInfo, const Event& NewEvent);
 
         void ConsumeEvents(const FBundledPackets& Packets, Chaos::FReal SimDt);
-        void ConsumeRemoteSimProxyOffset(const FRemoteSimProxyOffset& Offset);
+        void SetRemoteSimProxyOffsets(const TSharedPtr<FRemoteSimProxyOffsets>& NewRemoteSimProxyOffsets);
 
         void PreparePrePhysics(const FNetTickInfo& TickInfo);
         void ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole);
@@ -231,26 +391,38 @@ namespace ClientPrediction {
 
         DECLARE_DELEGATE_OneParam(FEmitEventBundleDelegate, const FBundledPackets& Bundle)
         FEmitEventBundleDelegate EmitEventBundle;
+        FEmitEventBundleDelegate EmitUnreliableEventBundle;
 
     private:
-        TMap<EventId, TUniquePtr<FEventFactoryBase>> Factories;
+        void EmitBundles(TArray<FEventSaver>& Serializers, const FEmitEventBundleDelegate& Delegate);
+
+        // Indexed by event id. Every frame only the factories that hold events are visited, and on the authority only the ones with events to send.
+        FEventFactoryTable Factories;
+        FEventIdMask RegisteredFactories;
+        FEventIdMask ActiveFactories;
+        FEventIdMask EmittingFactories;
 
         FCriticalSection EventMutex;
         int32 HistoryDuration = INDEX_NONE;
 
+        // The number of ticks of events each factory holds. Replaced with the length of the rewind history once the coordinator is initialized.
+        int32 BufferSize = 64;
+
         // Relevant only for the authorities
         int32 LatestEmittedTick = INDEX_NONE;
-        TQueue<FRemoteSimProxyOffset> QueuedRemoteSimProxyOffsets;
+        TSharedPtr<FRemoteSimProxyOffsets> RemoteSimProxyOffsets;
         int32 RemoteSimProxyOffset = 0;
     };
 
     template <typename EventType>
-    TMulticastDelegate<void(const EventType&, Chaos::FReal)>& USimEvents::RegisterEvent() {
+    TMulticastDelegate<void(const EventType&, Chaos::FReal)>& USimEvents::RegisterEvent(EEventDelivery Delivery) {
         const EventId EventId = FEventIds::GetId<EventType>();
-        TUniquePtr<FEventFactory<EventType>> Handler = MakeUnique<FEventFactory<EventType>>(EventId);
+        TUniquePtr<FEventFactory<EventType>> Handler = MakeUnique<FEventFactory<EventType>>(EventId, Delivery);
+        Handler->SetBufferSize(BufferSize);
 
         TMulticastDelegate<void(const EventType&, Chaos::FReal)>& Delegate = Handler->Delegate;
-        Factories.Add(EventId, MoveTemp(Handler));
+        Factories[EventId] = MoveTemp(Handler);
+        RegisteredFactories.Add(EventId);
 
         return Delegate;
     }
@@ -260,8 +432,11 @@ namespace ClientPrediction {
         FScopeLock EventLock(&EventMutex);
 
         const EventId EventId = FEventIds::GetId<EventType>();
-        if (!Factories.Contains(EventId)) { return; }
+        FEventFactoryBase* Factory = Factories[EventId].Get();
+        if (Factory == nullptr) { return; }
 
-        Factories[EventId]->CreateEvent(TickInfo, RemoteSimProxyOffset, &NewEvent);
+        Factory->CreateEvent(TickInfo, RemoteSimProxyOffset, &NewEvent);
+        ActiveFactories.Add(EventId);
+        EmittingFactories.Add(EventId);
     }
 }
@@ -3,15 +3,93 @@
 #include "ClientPredictionCVars.h"
 #include "ClientPredictionDelegate.h"
 #include "ClientPredictionNetSerialization.h"
+#include "ClientPredictionSchema.h"
+#include "ClientPredictionSimProxy.h"
 #include "ClientPredictionTick.h"
 
 namespace ClientPrediction {
-    class USimInputBase {
+    /**
+     * Measures how many of a client's input bundles are lost on the way to the authority and recommends how many inputs it should resend in each
+     * bundle. The window is a whole number of bundles worth of ticks: the one being sent, plus enough spare ones that losing all of them in a row is
+     * rarer than cp.InputTargetLoss at the measured loss rate. A gap the window didn't cover grows it right away, with a bundle to spare. Once per
+     * cp.InputLossInterval bundles the window grows to what the loss rate needs, or shrinks by one input if it's larger than both that and the largest
+     * gap of the interval, down to cp.MinInputWindowSize.
+     */
+    class CLIENTPREDICTION_API FInputLossTracker {
+    public:
+        /** Called on the physics thread with the oldest and newest ticks of every received input bundle. */
+        void RecordBundle(int32 OldestTick, int32 NewestTick);
+
+        /** Called on the physics thread when the authority had to simulate a tick without the input for it. */
+        void RecordStarvedTick();
+
+        /** The input window the client should use, or INDEX_NONE until enough inputs have been received to tell. */
+        int32 GetRecommendedWindowSize() const { return RecommendedWindowSize; }
+
+    private:
+        int32 LatestReceivedTick = INDEX_NONE;
+
+        // Measured over the current interval
+        int32 NumBundles = 0;
+        int32 NumLostBundles = 0;
+        int32 NumUnrecoveredTicks = 0;
+        int32 MinGap = TNumericLimits<int32>::Max();
+        int32 MaxGap = 0;
+
+        TAtomic<int32> RecommendedWindowSize = INDEX_NONE;
+    };
+
+    /**
+     * Measures how many ticks of input the authority has buffered ahead of the tick it is simulating, and works out how far the client should move its
+     * ticks to keep between cp.InputBufferTicks and cp.InputBufferTicks + cp.InputBufferSlackTicks buffered. The fewest ticks that were buffered over
+     * each cp.InputBufferInterval is used, since that tick came the closest to starving.
+     */
+    class CLIENTPREDICTION_API FInputBufferTracker {
+    public:
+        /** Called on the physics thread for every tick the authority simulates with input from a client. */
+        void RecordTick(int32 BufferedTicks);
+
+        FInputLeadAdjustment GetAdjustment() const;
+
+    private:
+        int32 NumTicks = 0;
+        int32 MinBufferedTicks = TNumericLimits<int32>::Max();
+
+        mutable FCriticalSection AdjustmentMutex;
+        FInputLeadAdjustment Adjustment{};
+    };
+
+    /** Tracks input loss and buffering on the authority and the input windows used by clients. Printed and reset with cp.InputRedundancyStats. */
+    struct CLIENTPREDICTION_API FInputRedundancyStats {
+        static void RecordInterval(int32 NumBundles, int32 NumLostBundles, int32 NumUnrecoveredTicks, int32 RecommendedWindowSize);
+        static void RecordBufferedTicks(int32 MinBufferedTicks, int32 LeadAdjustment);
+        static void RecordStarvedTick();
+        static void RecordSentWindow(int32 WindowSize);
+        static void LogAndReset();
+    };
+
+    class CLIENTPREDICTION_API USimInputBase {
     public:
         virtual ~USimInputBase() = default;
 
         DECLARE_DELEGATE_OneParam(FEmitInputBundleDelegate, const FBundledPackets& Bundle)
         FEmitInputBundleDelegate EmitInputBundleDelegate;
+
+        DECLARE_DELEGATE_OneParam(FEmitInputWindowSizeDelegate, uint8 WindowSize)
+        FEmitInputWindowSizeDelegate EmitInputWindowSizeDelegate;
+
+        DECLARE_DELEGATE_OneParam(FEmitInputLeadAdjustmentDelegate, const FInputLeadAdjustment& Adjustment)
+        FEmitInputLeadAdjustmentDelegate EmitInputLeadAdjustmentDelegate;
+
+        /** Called on the game thread of the client with the input window recommended by the authority. */
+        void SetSendWindowSize(int32 WindowSize);
+
+        /** Called on the physics thread of the authority with a bundle of inputs from the owning client. */
+        virtual void ConsumeInputBundle(const FBundledPackets& Packets) = 0;
+
+    protected:
+        FCriticalSection SendMutex;
+        int32 SendWindowSize = INDEX_NONE;
     };
 
     template <typename InputType>
@@ -19,12 +97,54 @@ namespace ClientPrediction {
         int32 ServerTick = INDEX_NONE;
         InputType Input;
 
+        /** The server tick is written by the bundle. */
         void NetSerialize(FArchive& Ar, void* Userdata) {
-            Ar << ServerTick;
-            Input.NetSerialize(Ar);
+            TSchemaOps<InputType>::NetSerializeInput(Input, Ar);
+        }
+
+        /**
+         * Inputs after the first one in a bundle are written against the input before them. Consecutive inputs are usually identical, in which case only
+         * a single bit is sent. Inputs with a schema otherwise send a change mask, so only the fields that changed are written.
+         */
+        void NetSerializeDelta(FArchive& Ar, void* Userdata, const FWrappedInput& Previous) {
+            uint8 bUnchanged = Ar.IsSaving() && IsInputUnchanged(Input, Previous.Input) ? 1 : 0;
+            Ar.SerializeBits(&bUnchanged, 1);
+
+            if (bUnchanged != 0) {
+                if (Ar.IsLoading()) { Input = Previous.Input; }
+                return;
+            }
+
+            if constexpr (THasSchema<InputType>::value) {
+                InputType::kSchema.NetSerializeDelta(Input, Previous.Input, Ar, EDataCompleteness::kFull);
+            }
+            else {
+                TSchemaOps<InputType>::NetSerializeInput(Input, Ar);
+            }
         }
+
+    private:
+        static bool IsInputUnchanged(const InputType& Input, const InputType& PreviousInput);
     };
 
+    template <typename InputType>
+    bool FWrappedInput<InputType>::IsInputUnchanged(const InputType& Input, const InputType& PreviousInput) {
+        if constexpr (THasSchema<InputType>::value) {
+            return InputType::kSchema.IsIdentical(Input, PreviousInput, EDataCompleteness::kFull);
+        }
+
+        TScopedScratch<FNetBitWriter> InputWriter;
+        TScopedScratch<FNetBitWriter> PreviousInputWriter;
+
+        InputType InputCopy = Input;
+        InputType PreviousInputCopy = PreviousInput;
+        TSchemaOps<InputType>::NetSerializeInput(InputCopy, *InputWriter);
+        TSchemaOps<InputType>::NetSerializeInput(PreviousInputCopy, *PreviousInputWriter);
+
+        return InputWriter->GetNumBits() == PreviousInputWriter->GetNumBits() &&
+            FMemory::Memcmp(InputWriter->GetData(), PreviousInputWriter->GetData(), InputWriter->GetNumBytes()) == 0;
+    }
+
     template <typename Traits>
     class USimInput : public USimInputBase {
     private:
@@ -43,20 +163,28 @@ namespace ClientPrediction {
         int32 BufferIndex(int32 ServerTick);
 
     public:
-        void ConsumeInputBundle(const FBundledPackets& Packets);
+        virtual void ConsumeInputBundle(const FBundledPackets& Packets) override;
 
         void InjectInputsGT();
         void PreparePrePhysics(const FNetTickInfo& TickInfo, const StateType& PrevState);
         void EmitInputs();
+        void EmitInputFeedback();
+
+        /** The newest tick that an input was received or produced for. If this is behind the tick being simulated, the sim is starved of input. */
+        int32 GetLatestInputTick() const { return LatestInputTick; }
 
     private:
         bool ShouldProduceInput(const FNetTickInfo& TickInfo);
 
+        /** Finds the input for a tick, or the most recent one before it if that input never arrived. */
+        const WrappedInput* FindInputForTick(int32 ServerTick);
+
     private:
         TArray<WrappedInput> Inputs;
         TQueue<WrappedInput> RecvQueue;
+        FInputLossTracker LossTracker;
+        FInputBufferTracker BufferTracker;
 
-        FCriticalSection SendMutex;
         TArray<WrappedInput> PendingSend; // Inputs that need to be sent at least once
         TArray<WrappedInput> SendWindow; // Inputs that were previously sent (behaves like a sliding window)
 
@@ -69,6 +197,7 @@ namespace ClientPrediction {
         InputType CurrentGTInput{};
 
         int32 LatestProducedInput = INDEX_NONE;
+        int32 LatestInputTick = INDEX_NONE;
     };
 
     template <typename Traits>
@@ -92,13 +221,24 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimInput<Traits>::ConsumeInputBundle(const FBundledPackets& Packets) {
-        TArray<WrappedInput> BundleInputs;
-        Packets.Bundle().Retrieve<>(BundleInputs, this);
+        TScopedScratch<TArray<WrappedInput>> BundleInputs;
+        Packets.Bundle().Retrieve<>(*BundleInputs, this);
+        if (BundleInputs->IsEmpty()) { return; }
+
+        int32 OldestTick = TNumericLimits<int32>::Max();
+        int32 NewestTick = TNumericLimits<int32>::Min();
+        for (const WrappedInput& NewInput : *BundleInputs) {
+            OldestTick = FMath::Min(OldestTick, NewInput.ServerTick);
+            NewestTick = FMath::Max(NewestTick, NewInput.ServerTick);
+        }
 
-        for (WrappedInput& NewInput : BundleInputs) {
+        LossTracker.RecordBundle(OldestTick, NewestTick);
+
+        for (WrappedInput& NewInput : *BundleInputs) {
             const int32 NewBufferIndex = BufferIndex(NewInput.ServerTick);
             if (Inputs[NewBufferIndex].ServerTick < NewInput.ServerTick) {
                 Inputs[NewBufferIndex] = NewInput;
+                LatestInputTick = FMath::Max(NewInput.ServerTick, LatestInputTick);
             }
         }
     }
@@ -125,26 +265,20 @@ namespace ClientPrediction {
 
             SimDelegates->ModifyInputPTDelegate.Broadcast(NewInput.Input, PrevState, FSimTickInfo(TickInfo));
             LatestProducedInput = FMath::Max(TickInfo.ServerTick, LatestProducedInput);
+            LatestInputTick = FMath::Max(TickInfo.ServerTick, LatestInputTick);
         }
 
         // We always use the server tick to find the input to use. This way if the server offset changes, the right input will still be picked.
-        int32 BestInputIndex = INDEX_NONE;
-        for (int32 Index = 0; Index < Inputs.Num(); ++Index) {
-            const WrappedInput& Input = Inputs[Index];
-            if (Input.ServerTick > TickInfo.ServerTick) { continue; }
-
-            if (Input.ServerTick == TickInfo.ServerTick) {
-                BestInputIndex = Index;
-                break;
-            }
-
-            if (BestInputIndex == INDEX_NONE || Inputs[BestInputIndex].ServerTick < Input.ServerTick) {
-                BestInputIndex = Index;
-            }
+        if (const WrappedInput* BestInput = FindInputForTick(TickInfo.ServerTick)) {
+            CurrentInput = *BestInput;
         }
 
-        if (BestInputIndex != INDEX_NONE) {
-            CurrentInput = Inputs[BestInputIndex];
+        if (TickInfo.SimRole == ROLE_Authority && TickInfo.bHasNetConnection && LatestInputTick != INDEX_NONE) {
+            BufferTracker.RecordTick(LatestInputTick - TickInfo.ServerTick);
+
+            if (CurrentInput.ServerTick != TickInfo.ServerTick) {
+                LossTracker.RecordStarvedTick();
+            }
         }
 
         if (TickInfo.SimRole == ROLE_AutonomousProxy) {
@@ -153,6 +287,29 @@ namespace ClientPrediction {
         }
     }
 
+    template <typename Traits>
+    const typename USimInput<Traits>::WrappedInput* USimInput<Traits>::FindInputForTick(int32 ServerTick) {
+        if (Inputs.IsEmpty()) { return nullptr; }
+
+        const WrappedInput& Input = Inputs[BufferIndex(ServerTick)];
+        if (Input.ServerTick == ServerTick) { return &Input; }
+
+        // When starved, the newest input is the most recent one before the tick.
+        if (LatestInputTick < ServerTick) {
+            const WrappedInput& LatestInput = Inputs[BufferIndex(LatestInputTick)];
+            return LatestInput.ServerTick == LatestInputTick ? &LatestInput : nullptr;
+        }
+
+        // Otherwise there's a gap, so walk back to the input before it. Gaps are only as long as the inputs that were lost.
+        const int32 OldestTick = ServerTick - Inputs.Num() + 1;
+        for (int32 Tick = ServerTick - 1; Tick >= OldestTick; --Tick) {
+            const WrappedInput& PreviousInput = Inputs[BufferIndex(Tick)];
+            if (PreviousInput.ServerTick == Tick) { return &PreviousInput; }
+        }
+
+        return nullptr;
+    }
+
     template <typename Traits>
     void USimInput<Traits>::EmitInputs() {
         FScopeLock SendLock(&SendMutex);
@@ -160,20 +317,37 @@ namespace ClientPrediction {
             return;
         }
 
-        int32 SendWindowMaxSize = FMath::Max(PendingSend.Num(), ClientPredictionInputWindowSize);
+        const int32 WindowSize = SendWindowSize == INDEX_NONE ? ClientPredictionInputWindowSize : SendWindowSize;
+        int32 SendWindowMaxSize = FMath::Max(PendingSend.Num(), WindowSize);
         SendWindow.Append(PendingSend);
 
         while (SendWindow.Num() > SendWindowMaxSize) {
             SendWindow.RemoveAt(0);
         }
 
-        FBundledPackets Packets{};
-        Packets.Bundle().Store(SendWindow, this);
+        FBundledPackets::BundleType::StoreChunked(SendWindow, this, [&](const FBundledPackets::BundleType& Bundle) {
+            FBundledPackets Packets{};
+            Packets.Bundle() = Bundle;
+
+            EmitInputBundleDelegate.ExecuteIfBound(Packets);
+        });
 
-        EmitInputBundleDelegate.ExecuteIfBound(Packets);
+        FInputRedundancyStats::RecordSentWindow(SendWindow.Num());
         PendingSend.Reset();
     }
 
+    template <typename Traits>
+    void USimInput<Traits>::EmitInputFeedback() {
+        const int32 WindowSize = LossTracker.GetRecommendedWindowSize();
+        if (ClientPredictionAdaptiveInputWindow != 0 && WindowSize != INDEX_NONE) {
+            EmitInputWindowSizeDelegate.ExecuteIfBound(static_cast<uint8>(FMath::Clamp(WindowSize, 1, static_cast<int32>(TNumericLimits<uint8>::Max()))));
+        }
+
+        if (ClientPredictionAdaptiveInputLead != 0) {
+            EmitInputLeadAdjustmentDelegate.ExecuteIfBound(BufferTracker.GetAdjustment());
+        }
+    }
+
     template <typename Traits>
     bool USimInput<Traits>::ShouldProduceInput(const FNetTickInfo& TickInfo) {
         const bool bShouldTakeInput =
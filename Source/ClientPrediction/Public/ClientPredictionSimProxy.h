@@ -1,8 +1,11 @@
 ﻿#pragma once
 
 #include "CoreMinimal.h"
+#include "Engine/NetConnection.h"
 
+#include "ClientPredictionNetSerialization.h"
 #include "ClientPredictionTick.h"
+#include "ClientPredictionSimScheduler.h"
 #include "ClientPredictionSimProxy.generated.h"
 
 USTRUCT()
@@ -29,6 +32,64 @@ struct TStructOpsTypeTraits<FRemoteSimProxyOffset> : public TStructOpsTypeTraits
     };
 };
 
+/**
+ * Sent by the authority to tell a client whether its ticks are too close to the authority (inputs arrive too late) or too far ahead (inputs wait in the
+ * buffer too long). Every measurement gets a new sequence, so the same adjustment twice in a row still replicates.
+ */
+USTRUCT()
+struct FInputLeadAdjustment {
+    GENERATED_BODY()
+
+    int8 Ticks = 0;
+    uint8 Sequence = 0;
+
+    inline bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+bool FInputLeadAdjustment::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+    Ar << Ticks;
+    Ar << Sequence;
+
+    return true;
+}
+
+template <>
+struct TStructOpsTypeTraits<FInputLeadAdjustment> : public TStructOpsTypeTraitsBase2<FInputLeadAdjustment> {
+    enum {
+        WithNetSerializer = true
+    };
+};
+
+namespace ClientPrediction {
+    /**
+     * The remote sim proxy offsets reported by one connection, in the order they should be applied. Clients report an offset once rather than once per
+     * sim, so on the authority every sim controlled by that connection shares this.
+     */
+    class CLIENTPREDICTION_API FRemoteSimProxyOffsets {
+    public:
+        void Add(const FRemoteSimProxyOffset& Offset);
+
+        /** Returns the newest offset that applies to ServerTick. Older offsets are dropped, since the authority never goes back to an earlier tick. */
+        TOptional<int32> GetOffsetForTick(int32 ServerTick);
+
+    private:
+        FCriticalSection OffsetsMutex;
+        TArray<FRemoteSimProxyOffset> Offsets;
+    };
+}
+
+/** A bundle emitted by a single sim. Inputs from every sim a client controls, and events for every sim a connection can see, are sent together. */
+USTRUCT()
+struct FAggregatedBundle {
+    GENERATED_BODY()
+
+    UPROPERTY()
+    class UClientPredictionV2Component* Component = nullptr;
+
+    UPROPERTY()
+    FBundledPackets Bundle;
+};
+
 UCLASS()
 class CLIENTPREDICTION_API AClientPredictionSimProxyManager : public AActor {
     GENERATED_BODY()
@@ -48,6 +109,32 @@ public:
     int32 GetLocalToServerOffset() const;
     const TOptional<FRemoteSimProxyOffset>& GetRemoteSimProxyOffset() const;
 
+    /** Components controlled by this client. The remote sim proxy offset is sent to the authority once through any one of them. */
+    void RegisterAutonomousComponent(class UClientPredictionV2Component* Component);
+    void UnregisterAutonomousComponent(class UClientPredictionV2Component* Component);
+    void FlushRemoteSimProxyOffset();
+
+    /** Called on the authority with the offset that a client reported. */
+    void ConsumeRemoteSimProxyOffset(const class UNetConnection* Connection, const FRemoteSimProxyOffset& Offset);
+    TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets> GetRemoteSimProxyOffsets(const class UNetConnection* Connection);
+
+    /** The number of ticks that autonomous proxies on this client are moved ahead of the network physics tick offset. */
+    int32 GetInputLeadOffset() const;
+
+    /** Moves autonomous proxies one tick in the direction of the adjustment, at most once every cp.InputLeadStepInterval. */
+    void AdjustInputLead(const FInputLeadAdjustment& Adjustment);
+
+    /** Queues an input bundle on the client. Everything queued during a tick is sent with as few RPCs as possible once every sim has emitted its inputs. */
+    void QueueInputBundle(class UClientPredictionV2Component* Component, const FBundledPackets& Bundle);
+    void FlushInputBundles();
+
+    /** Queues an event bundle on the authority. Once every sim has emitted its events, each connection is sent the ones for sims it can see. */
+    void QueueEventBundle(class UClientPredictionV2Component* Component, const FBundledPackets& Bundle);
+    void QueueUnreliableEventBundle(class UClientPredictionV2Component* Component, const FBundledPackets& Bundle);
+    void FlushEventBundles();
+
+    ClientPrediction::FSimScheduler& GetScheduler() const { return *Scheduler; }
+
 private:
     UFUNCTION()
     void LatestServerTickChangedGT();
@@ -61,8 +148,25 @@ private:
     /** This offset can be added to a local tick to get the server tick for sim proxies. */
     int32 LocalToServerOffset = INDEX_NONE;
     TOptional<FRemoteSimProxyOffset> RemoteSimProxyOffset{};
+    bool bRemoteSimProxyOffsetDirty = false;
 
-public:
-    DECLARE_MULTICAST_DELEGATE_OneParam(FRemoteSimProxyOffsetChangedDelegate, const TOptional<FRemoteSimProxyOffset>& Offset)
-    FRemoteSimProxyOffsetChangedDelegate RemoteSimProxyOffsetChangedDelegate;
+    TArray<TWeakObjectPtr<class UClientPredictionV2Component>> AutonomousComponents;
+    TMap<TWeakObjectPtr<const class UNetConnection>, TSharedPtr<ClientPrediction::FRemoteSimProxyOffsets>> ConnectionRemoteSimProxyOffsets;
+
+    int32 InputLeadOffset = 0;
+    double LastInputLeadStepTime = -1.0;
+
+    TArray<FAggregatedBundle> PendingInputBundles;
+    TArray<FAggregatedBundle> PendingEventBundles;
+    TArray<FAggregatedBundle> PendingUnreliableEventBundles;
+
+    /**
+     * Spawns a connection manager for every player controller with a connection that doesn't have one yet, and destroys the managers of controllers that
+     * were destroyed or lost their connection, for example when the player logged out or the controller was swapped.
+     */
+    void UpdateConnectionManagers();
+    TMap<TWeakObjectPtr<class APlayerController>, TWeakObjectPtr<class AClientPredictionConnectionManager>> ConnectionManagers;
+
+    /** Ticks all of the coordinators in this world. */
+    TUniquePtr<ClientPrediction::FSimScheduler> Scheduler;
 };
@@ -0,0 +1,311 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "PBDRigidsSolver.h"
+#include "Async/ParallelFor.h"
+#include "Chaos/SimCallbackObject.h"
+
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionUtils.h"
+
+class FChaosScene;
+
+namespace ClientPrediction {
+    class USimCoordinatorBase;
+
+    template <typename Traits>
+    class USimCoordinator;
+
+    /**
+     * Sims can opt in to having part of their physics thread ticks run in parallel with other sims of the same type by declaring
+     * static constexpr bool bThreadSafeTick = true; in their traits and setting cp.ParallelSimTicks. Only input lookup and state building run in parallel,
+     * so GenerateInitialStatePTDelegate and ModifyInputPTDelegate must then only touch that sim's own state and must not change any physics body.
+     * Corrections, the end of the sim and the sim ticks can change the physics body, which isn't safe to do from several threads at once, so they and
+     * SimTickPrePhysicsDelegate, SimTickPostPhysicsDelegate and IsSimFinishedDelegate always run serially.
+     */
+    template <typename Traits, typename = void>
+    struct TIsSimTickThreadSafe : std::false_type {};
+
+    template <typename Traits>
+    struct TIsSimTickThreadSafe<Traits, std::void_t<decltype(Traits::bThreadSafeTick)>> : std::bool_constant<Traits::bThreadSafeTick> {};
+
+    /**
+     * Drives every coordinator that shares a Traits type. The scheduler keeps one group per type for the game thread and one for the physics thread, and
+     * each is only ever touched by its own thread.
+     */
+    class FSimGroupBase {
+    public:
+        virtual ~FSimGroupBase() = default;
+
+        virtual bool IsEmpty() const = 0;
+
+        virtual void InjectInputsGT() = 0;
+        virtual void PreAdvance(const int32 TickNum, const FWorldTickContext& Context) = 0;
+        virtual void PostAdvance(const FWorldTickContext& Context) = 0;
+        virtual int32 TriggerRewindIfNeeded(const FWorldTickContext& Context) = 0;
+        virtual void PostTickGT(const FWorldTickContext& Context) = 0;
+    };
+
+    template <typename Traits>
+    class TSimGroup : public FSimGroupBase {
+    public:
+        void Add(USimCoordinator<Traits>* Coordinator);
+        void Remove(USimCoordinator<Traits>* Coordinator);
+
+        virtual bool IsEmpty() const override { return Coordinators.IsEmpty(); }
+
+        virtual void InjectInputsGT() override;
+        virtual void PreAdvance(const int32 TickNum, const FWorldTickContext& Context) override;
+        virtual void PostAdvance(const FWorldTickContext& Context) override;
+        virtual int32 TriggerRewindIfNeeded(const FWorldTickContext& Context) override;
+        virtual void PostTickGT(const FWorldTickContext& Context) override;
+
+    private:
+        /**
+         * Coordinators can be added or removed while the group is being ticked (for example by game code that runs when events are executed), so this
+         * iterates by index and defers compacting removed coordinators until the outermost loop finishes.
+         */
+        template <typename Func>
+        void ForEachCoordinator(Func&& Callback);
+
+        /** Whether the phases of the physics thread ticks that don't change physics bodies can fan out to worker threads. */
+        bool CanTickInParallel() const;
+
+        /** Must only be used for phases that don't change physics bodies. */
+        template <typename Func>
+        void ForEachCoordinatorParallel(Func&& Callback);
+
+        TArray<USimCoordinator<Traits>*> Coordinators;
+        int32 IterationDepth = 0;
+        bool bHasRemovedCoordinators = false;
+    };
+
+    struct CLIENTPREDICTION_API FSimGroupIds {
+        /** Ids are handed out by the module so that every module instantiating GetId shares the same counter. */
+        static int32 AllocateId();
+
+        template <typename Traits>
+        static int32 GetId() {
+            static const int32 kGroupId = AllocateId();
+            return kGroupId;
+        }
+    };
+
+    /**
+     * Owns the physics callbacks for every coordinator in a world. Instead of every coordinator registering its own delegates and rewind callback, the
+     * scheduler registers them once and ticks each group of coordinators in a single loop.
+     */
+    class CLIENTPREDICTION_API FSimScheduler : public Chaos::ISimCallbackObject {
+    public:
+        FSimScheduler(UWorld* World, AClientPredictionSimProxyManager* SimProxyWorldManager);
+        virtual ~FSimScheduler() override;
+
+        /** Registration happens on the game thread. The physics thread picks up the change before its next callback. */
+        template <typename Traits>
+        void Register(USimCoordinator<Traits>* Coordinator);
+
+        template <typename Traits>
+        void Unregister(USimCoordinator<Traits>* Coordinator);
+
+        /**
+         * Called on the game thread with an unregistered coordinator. The physics thread might still be ticking it, so it is only deleted once the physics
+         * thread has picked up the unregistration.
+         */
+        void Retire(TUniquePtr<USimCoordinatorBase> Coordinator);
+
+        /** Called on the game thread. The change is applied to the physics thread's groups at the start of its next callback. */
+        void QueueChangePT(TUniqueFunction<void()>&& Change);
+
+    private:
+        using FGroupList = TArray<TUniquePtr<FSimGroupBase>>;
+
+        template <typename Traits>
+        static TSimGroup<Traits>& GetGroup(FGroupList& GroupList);
+
+        template <typename Func>
+        static void ForEachGroup(FGroupList& GroupList, Func&& Callback);
+
+        void ApplyChangesPT();
+
+        /** Looks up everything that is shared by the coordinators once, rather than every coordinator walking the world on its own. */
+        bool BuildTickContext(FWorldTickContext& Context) const;
+
+        void RegisterCallbacks();
+        void UnregisterCallbacks();
+
+        virtual Chaos::FSimCallbackInput* AllocateInputData_External() override { return nullptr; }
+        virtual void FreeOutputData_External(Chaos::FSimCallbackOutput* Output) override {}
+        virtual void FreeInputData_Internal(Chaos::FSimCallbackInput* Input) override {}
+        virtual void OnPreSimulate_Internal() override {}
+        virtual int32 TriggerRewindIfNeeded_Internal(int32 LastCompletedTick) override;
+
+        void InjectInputsGT(const int32 StartTick, const int32 NumTicks);
+        void PreAdvance(const int32 TickNum);
+        void PostAdvance(Chaos::FReal Dt);
+        void OnPhysScenePostTick(FChaosScene* Scene);
+
+        UWorld* World = nullptr;
+        AClientPredictionSimProxyManager* SimProxyWorldManager = nullptr;
+        bool bRegisteredCallbacks = false;
+
+        FDelegateHandle InjectInputsGTDelegateHandle;
+        FDelegateHandle PreAdvanceDelegateHandle;
+        FDelegateHandle PostAdvanceDelegateHandle;
+        FDelegateHandle PhysScenePostTickDelegateHandle;
+
+        /** Indexed by FSimGroupIds. Groups is owned by the game thread and GroupsPT by the physics thread, so neither thread waits on the other's ticks. */
+        FGroupList Groups;
+        FGroupList GroupsPT;
+
+        // Only held while changes are queued or taken off the queue, never during a tick.
+        FCriticalSection ChangesMutex;
+        TArray<TUniqueFunction<void()>> PendingChangesPT;
+    };
+
+    template <typename Traits>
+    void TSimGroup<Traits>::Add(USimCoordinator<Traits>* Coordinator) {
+        Coordinators.AddUnique(Coordinator);
+    }
+
+    template <typename Traits>
+    void TSimGroup<Traits>::Remove(USimCoordinator<Traits>* Coordinator) {
+        const int32 Index = Coordinators.Find(Coordinator);
+        if (Index == INDEX_NONE) { return; }
+
+        if (IterationDepth == 0) {
+            Coordinators.RemoveAt(Index);
+            return;
+        }
+
+        Coordinators[Index] = nullptr;
+        bHasRemovedCoordinators = true;
+    }
+
+    template <typename Traits>
+    template <typename Func>
+    void TSimGroup<Traits>::ForEachCoordinator(Func&& Callback) {
+        ++IterationDepth;
+        for (int32 Index = 0; Index < Coordinators.Num(); ++Index) {
+            if (USimCoordinator<Traits>* Coordinator = Coordinators[Index]) { Callback(*Coordinator); }
+        }
+
+        if (--IterationDepth == 0 && bHasRemovedCoordinators) {
+            Coordinators.Remove(nullptr);
+            bHasRemovedCoordinators = false;
+        }
+    }
+
+    template <typename Traits>
+    bool TSimGroup<Traits>::CanTickInParallel() const {
+        if constexpr (TIsSimTickThreadSafe<Traits>::value) {
+            return ClientPredictionParallelSimTicks != 0 && Coordinators.Num() > 1;
+        }
+        else {
+            return false;
+        }
+    }
+
+    template <typename Traits>
+    template <typename Func>
+    void TSimGroup<Traits>::ForEachCoordinatorParallel(Func&& Callback) {
+        // The physics thread only applies registration changes between its callbacks, so the array is stable for the whole dispatch. The depth is still
+        // tracked so that a removal can never compact the array underneath the workers.
+        ++IterationDepth;
+        ParallelFor(Coordinators.Num(), [&](const int32 Index) {
+            if (USimCoordinator<Traits>* Coordinator = Coordinators[Index]) { Callback(*Coordinator); }
+        });
+
+        if (--IterationDepth == 0 && bHasRemovedCoordinators) {
+            Coordinators.Remove(nullptr);
+            bHasRemovedCoordinators = false;
+        }
+    }
+
+    template <typename Traits>
+    void TSimGroup<Traits>::InjectInputsGT() {
+        ForEachCoordinator([](USimCoordinator<Traits>& Coordinator) { Coordinator.InjectInputsGT(); });
+    }
+
+    template <typename Traits>
+    void TSimGroup<Traits>::PreAdvance(const int32 TickNum, const FWorldTickContext& Context) {
+        if (!CanTickInParallel()) {
+            ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) { Coordinator.PreAdvance(TickNum, Context); });
+            return;
+        }
+
+        // Corrections and the sim ticks can change the physics bodies, so only the preparation in between runs in parallel.
+        ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) { Coordinator.BeginPreAdvance(TickNum, Context); });
+        ForEachCoordinatorParallel([](USimCoordinator<Traits>& Coordinator) { Coordinator.PreparePrePhysics(); });
+        ForEachCoordinator([](USimCoordinator<Traits>& Coordinator) { Coordinator.TickPrePhysics(); });
+    }
+
+    template <typename Traits>
+    void TSimGroup<Traits>::PostAdvance(const FWorldTickContext& Context) {
+        if (!CanTickInParallel()) {
+            ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) { Coordinator.PostAdvance(Context); });
+            return;
+        }
+
+        ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) { Coordinator.TickPostPhysics(Context); });
+        ForEachCoordinatorParallel([](USimCoordinator<Traits>& Coordinator) { Coordinator.RecordPostPhysics(); });
+    }
+
+    template <typename Traits>
+    int32 TSimGroup<Traits>::TriggerRewindIfNeeded(const FWorldTickContext& Context) {
+        int32 RewindTick = INDEX_NONE;
+        ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) {
+            const int32 CoordinatorRewindTick = Coordinator.TriggerRewindIfNeeded(Context);
+            if (CoordinatorRewindTick == INDEX_NONE) { return; }
+
+            RewindTick = RewindTick == INDEX_NONE ? CoordinatorRewindTick : FMath::Min(RewindTick, CoordinatorRewindTick);
+        });
+
+        return RewindTick;
+    }
+
+    template <typename Traits>
+    void TSimGroup<Traits>::PostTickGT(const FWorldTickContext& Context) {
+        ForEachCoordinator([&](USimCoordinator<Traits>& Coordinator) { Coordinator.PostTickGT(Context); });
+    }
+
+    template <typename Traits>
+    void FSimScheduler::Register(USimCoordinator<Traits>* Coordinator) {
+        check(IsInGameThread());
+
+        GetGroup<Traits>(Groups).Add(Coordinator);
+        QueueChangePT([this, Coordinator]() { GetGroup<Traits>(GroupsPT).Add(Coordinator); });
+
+        RegisterCallbacks();
+    }
+
+    template <typename Traits>
+    void FSimScheduler::Unregister(USimCoordinator<Traits>* Coordinator) {
+        check(IsInGameThread());
+
+        GetGroup<Traits>(Groups).Remove(Coordinator);
+        QueueChangePT([this, Coordinator]() { GetGroup<Traits>(GroupsPT).Remove(Coordinator); });
+    }
+
+    template <typename Traits>
+    TSimGroup<Traits>& FSimScheduler::GetGroup(FGroupList& GroupList) {
+        const int32 GroupId = FSimGroupIds::GetId<Traits>();
+        if (!GroupList.IsValidIndex(GroupId)) {
+            GroupList.SetNum(GroupId + 1);
+        }
+
+        if (GroupList[GroupId] == nullptr) {
+            GroupList[GroupId] = MakeUnique<TSimGroup<Traits>>();
+        }
+
+        return static_cast<TSimGroup<Traits>&>(*GroupList[GroupId]);
+    }
+
+    template <typename Func>
+    void FSimScheduler::ForEachGroup(FGroupList& GroupList, Func&& Callback) {
+        // Groups can be added while iterating, so this can't hold on to an iterator.
+        for (int32 GroupId = 0; GroupId < GroupList.Num(); ++GroupId) {
+            FSimGroupBase* Group = GroupList[GroupId].Get();
+            if (Group != nullptr && !Group->IsEmpty()) { Callback(*Group); }
+        }
+    }
+}
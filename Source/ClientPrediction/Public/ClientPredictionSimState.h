@@ -10,7 +10,10 @@
 #include "ClientPredictionSimEvents.h"
 #include "ClientPredictionTick.h"
 #include "ClientPredictionPhysState.h"
+#include "ClientPredictionSchema.h"
 #include "ClientPredictionCVars.h"
+#include "ClientPredictionSpscRing.h"
+#include "ClientPredictionTickHistory.h"
 #include "Runtime/Experimental/Chaos/Private/Chaos/PhysicsObjectInternal.h"
 
 namespace ClientPrediction {
@@ -27,40 +30,203 @@ namespace ClientPrediction {
         Chaos::FReal StartTime = 0.0;
         Chaos::FReal EndTime = 0.0;
 
-        void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, void* Userdata);
+        void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, const FPhysQuantization* Quantization);
         void Interpolate(const FWrappedState& Other, Chaos::FReal Alpha);
+
+        /** Writes the interpolation between two states into this one. Only what the game thread presents is written, so the velocities are left untouched. */
+        void InterpolateForGameThread(const FWrappedState& Start, const FWrappedState& End, Chaos::FReal Alpha);
         void Extrapolate(const FWrappedState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime);
     };
 
     template <typename StateType>
-    void FWrappedState<StateType>::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, void* Userdata) {
-        if (Ar.IsSaving()) {
-            checkSlow(ServerTick >= INDEX_NONE);
+    void FWrappedState<StateType>::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, const FPhysQuantization* Quantization) {
+        // The server tick is written by the bundle.
+        uint8 bFinal = bIsFinalState ? 1 : 0;
+        Ar.SerializeBits(&bFinal, 1);
+        bIsFinalState = bFinal != 0;
+
+        PhysState.NetSerialize(Ar, Completeness, Quantization != nullptr ? *Quantization : FPhysQuantization::Default());
+        TSchemaOps<StateType>::NetSerialize(State, Ar, Completeness);
+    }
+
+    template <typename StateType>
+    void FWrappedState<StateType>::Interpolate(const FWrappedState& Other, Chaos::FReal Alpha) {
+        PhysState.Interpolate(Other.PhysState, Alpha);
+        TSchemaOps<StateType>::Interpolate(State, Other.State, Alpha);
+    }
+
+    template <typename StateType>
+    void FWrappedState<StateType>::InterpolateForGameThread(const FWrappedState& Start, const FWrappedState& End, Chaos::FReal Alpha) {
+        LocalTick = Start.LocalTick;
+        ServerTick = Start.ServerTick;
+        bIsFinalState = Start.bIsFinalState;
+
+        StartTime = Start.StartTime;
+        EndTime = Start.EndTime;
+
+        State = Start.State;
+        TSchemaOps<StateType>::Interpolate(State, End.State, Alpha);
+        PhysState.InterpolateTransform(Start.PhysState, End.PhysState, Alpha);
+    }
+
+    template <typename StateType>
+    void FWrappedState<StateType>::Extrapolate(const FWrappedState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime) {
+        PhysState.Extrapolate(PrevState.PhysState, StateDt, ExtrapolationTime);
+    }
+
+    /**
+     * The form sim proxy states are delta encoded in. Every state is encoded against the previous state that the connection was sent, so each one is also
+     * the baseline for the next.
+     */
+    template <typename StateType>
+    struct FSimProxyDeltaState : public FStateBaseline {
+        int32 ServerTick = INDEX_NONE;
+        bool bIsFinalState = false;
+
+        StateType State{};
+        FQuantizedPhysState PhysState{};
+
+        /**
+         * The server tick is not serialized here, it's written relative to the other states in the bundle. When saving, bStateUnchanged says whether the
+         * user state serializes the same as the previous one. It is worked out once per bundle by the encoder, since it doesn't depend on the connection.
+         */
+        void NetSerialize(FArchive& Ar, const FSimProxyDeltaState& Previous, bool bStateUnchanged = false);
+
+        static bool IsStateUnchanged(const StateType& State, const StateType& PreviousState);
+    };
+
+    template <typename StateType>
+    void FSimProxyDeltaState<StateType>::NetSerialize(FArchive& Ar, const FSimProxyDeltaState& Previous, const bool bStateUnchanged) {
+        uint8 bFinal = bIsFinalState ? 1 : 0;
+        Ar.SerializeBits(&bFinal, 1);
+        bIsFinalState = bFinal != 0;
 
-            uint32 Packed = (ServerTick + 1) | (bIsFinalState << 31);
-            Ar << Packed;
+        PhysState.NetSerializeDelta(Ar, Previous.PhysState);
+
+        // States with a schema get a change mask, so only the fields that changed are sent.
+        if constexpr (THasSchema<StateType>::value) {
+            StateType::kSchema.NetSerializeDelta(State, Previous.State, Ar, EDataCompleteness::kLow);
+            return;
         }
-        else {
-            uint32 Packed;
-            Ar << Packed;
 
-            ServerTick = static_cast<int32>(Packed & ~0x80000000) - 1;
-            bIsFinalState = static_cast<bool>(Packed >> 31);
+        // The user state is only sent if its serialized form changed, otherwise the receiver just copies the previous one.
+        uint8 bUnchanged = Ar.IsSaving() && bStateUnchanged ? 1 : 0;
+        Ar.SerializeBits(&bUnchanged, 1);
+
+        if (bUnchanged == 0) {
+            TSchemaOps<StateType>::NetSerialize(State, Ar, EDataCompleteness::kLow);
+        }
+        else if (Ar.IsLoading()) {
+            State = Previous.State;
         }
+    }
+
+    template <typename StateType>
+    bool FSimProxyDeltaState<StateType>::IsStateUnchanged(const StateType& State, const StateType& PreviousState) {
+        // States with a schema are delta encoded field by field and never need this.
+        if constexpr (THasSchema<StateType>::value) { return false; }
 
-        PhysState.NetSerialize(Ar, Completeness);
-        State.NetSerialize(Ar, Completeness);
+        TScopedScratch<FNetBitWriter> StateWriter;
+        TScopedScratch<FNetBitWriter> PreviousStateWriter;
+
+        StateType StateCopy = State;
+        StateType PreviousStateCopy = PreviousState;
+        TSchemaOps<StateType>::NetSerialize(StateCopy, *StateWriter, EDataCompleteness::kLow);
+        TSchemaOps<StateType>::NetSerialize(PreviousStateCopy, *PreviousStateWriter, EDataCompleteness::kLow);
+
+        return StateWriter->GetNumBits() == PreviousStateWriter->GetNumBits() &&
+            FMemory::Memcmp(StateWriter->GetData(), PreviousStateWriter->GetData(), StateWriter->GetNumBytes()) == 0;
     }
 
+    /**
+     * Encodes the sim proxy states of one emitted bundle for every connection it's replicated to. Encoders are pooled, so the state array keeps its
+     * allocation between bundles.
+     */
     template <typename StateType>
-    void FWrappedState<StateType>::Interpolate(const FWrappedState& Other, Chaos::FReal Alpha) {
-        PhysState.Interpolate(Other.PhysState, Alpha);
-        State.Interpolate(Other.State, Alpha);
+    struct TSimProxyStateEncoder : public FDeltaEncoder {
+        using DeltaState = FSimProxyDeltaState<StateType>;
+        TArray<DeltaState> States;
+
+        // Whatever a connection's states were encoded against, its baseline afterwards is the last state, so every connection shares this one.
+        TSharedPtr<FStateBaseline> LastState;
+
+        // The last state of the previous bundle, which is the baseline of every connection that received it.
+        TSharedPtr<FStateBaseline> PreviousLastState;
+
+        /**
+         * Works out which user states are unchanged from the state before them. The first state is compared against both the previous bundle's last
+         * state and the keyframe default, which covers every connection that isn't behind by more than a bundle.
+         */
+        void BuildUnchangedStates();
+
+        virtual TSharedPtr<FStateBaseline> Encode(FBitWriter& Writer, const FStateBaseline* Baseline) const override;
+
+    private:
+        TArray<bool> UnchangedStates;
+        bool bFirstUnchangedFromKeyframe = false;
+    };
+
+    template <typename StateType>
+    void TSimProxyStateEncoder<StateType>::BuildUnchangedStates() {
+        UnchangedStates.Reset();
+        bFirstUnchangedFromKeyframe = false;
+        if (States.IsEmpty()) { return; }
+
+        const DeltaState* PreviousBundleState = static_cast<const DeltaState*>(PreviousLastState.Get());
+        UnchangedStates.Add(PreviousBundleState != nullptr && DeltaState::IsStateUnchanged(States[0].State, PreviousBundleState->State));
+        bFirstUnchangedFromKeyframe = DeltaState::IsStateUnchanged(States[0].State, StateType{});
+
+        for (int32 StateIdx = 1; StateIdx < States.Num(); ++StateIdx) {
+            UnchangedStates.Add(DeltaState::IsStateUnchanged(States[StateIdx].State, States[StateIdx - 1].State));
+        }
     }
 
     template <typename StateType>
-    void FWrappedState<StateType>::Extrapolate(const FWrappedState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime) {
-        PhysState.Extrapolate(PrevState.PhysState, StateDt, ExtrapolationTime);
+    TSharedPtr<FStateBaseline> TSimProxyStateEncoder<StateType>::Encode(FBitWriter& Writer, const FStateBaseline* Baseline) const {
+        check(!States.IsEmpty());
+        const int64 StartBits = Writer.GetNumBits();
+
+        // Sim proxies only keep a limited window of baselines, so anything older than that is sent as a keyframe instead.
+        const DeltaState* TypedBaseline = static_cast<const DeltaState*>(Baseline);
+        if (TypedBaseline != nullptr) {
+            const int32 BaselineAge = States[0].ServerTick - TypedBaseline->ServerTick;
+            if (BaselineAge <= 0 || BaselineAge > ClientPredictionSimProxyMaxBaselineAge) { TypedBaseline = nullptr; }
+        }
+
+        uint32 NumStates = static_cast<uint32>(States.Num());
+        uint32 PackedFirstTick = static_cast<uint32>(States[0].ServerTick + 1);
+        uint8 bHasBaseline = TypedBaseline != nullptr ? 1 : 0;
+
+        Writer.SerializeIntPacked(NumStates);
+        Writer.SerializeIntPacked(PackedFirstTick);
+        Writer.SerializeBits(&bHasBaseline, 1);
+
+        // Keyframes are encoded against a default state, which keeps the encoding the same for both.
+        DeltaState Previous = TypedBaseline != nullptr ? *TypedBaseline : DeltaState{};
+        if (TypedBaseline != nullptr) {
+            uint32 BaselineAge = static_cast<uint32>(States[0].ServerTick - TypedBaseline->ServerTick);
+            Writer.SerializeIntPacked(BaselineAge);
+        }
+
+        // Only a connection that missed the previous bundle has a first state that wasn't compared up front.
+        bool bFirstUnchanged = bFirstUnchangedFromKeyframe;
+        if (TypedBaseline != nullptr) {
+            bFirstUnchanged = TypedBaseline == PreviousLastState.Get() ? UnchangedStates[0] : DeltaState::IsStateUnchanged(States[0].State, TypedBaseline->State);
+        }
+
+        for (int32 StateIdx = 0; StateIdx < States.Num(); ++StateIdx) {
+            DeltaState State = States[StateIdx];
+            if (StateIdx > 0) {
+                uint32 TickDelta = static_cast<uint32>(State.ServerTick - States[StateIdx - 1].ServerTick);
+                Writer.SerializeIntPacked(TickDelta);
+            }
+
+            State.NetSerialize(Writer, Previous, StateIdx > 0 ? UnchangedStates[StateIdx] : bFirstUnchanged);
+            Previous = MoveTemp(State);
+        }
+
+        FStateBandwidthStats::Record(Writer.GetNumBits() - StartBits, States.Num(), TypedBaseline == nullptr);
+        return LastState;
     }
 
     enum class ESimStage {
@@ -73,8 +239,8 @@ namespace ClientPrediction {
     public:
         virtual ~USimStateBase() = default;
 
-        DECLARE_DELEGATE_OneParam(FEmitLowStateDelegate, const FBundledPacketsLow& Bundle)
-        FEmitLowStateDelegate EmitSimProxyBundle;
+        DECLARE_DELEGATE_OneParam(FEmitDeltaStateDelegate, const FBundledPacketsDelta& Bundle)
+        FEmitDeltaStateDelegate EmitSimProxyBundle;
 
         DECLARE_DELEGATE_OneParam(FEmitFullStateDelegate, const FBundledPacketsFull& Bundle)
         FEmitFullStateDelegate EmitAutoProxyBundle;
@@ -87,6 +253,7 @@ namespace ClientPrediction {
         using InputType = typename Traits::InputType;
         using StateType = typename Traits::StateType;
         using WrappedState = FWrappedState<StateType>;
+        using DeltaState = FSimProxyDeltaState<StateType>;
 
     public:
         virtual ~USimState() override = default;
@@ -99,12 +266,15 @@ namespace ClientPrediction {
         TSharedPtr<USimEvents> SimEvents;
 
     public:
-        void ConsumeSimProxyStates(const FBundledPacketsLow& Packets, Chaos::FReal SimDt);
+        void ConsumeSimProxyStates(const FBundledPacketsDelta& Packets, Chaos::FReal SimDt);
         void ConsumeAutoProxyStates(const FBundledPacketsFull& Packets);
         void ConsumeFinalState(const FBundledPacketsFull& Packets, const FNetTickInfo& TickInfo);
 
     private:
         void UpdateTimesRecvSimProxy(WrappedState& State, Chaos::FReal SimDt);
+        void DecodeSimProxyStates(FArchive& Ar, Chaos::FReal SimDt);
+
+        static DeltaState MakeDeltaState(const WrappedState& State);
 
     private:
         static void FillStateSimDetails(WrappedState& State, const FNetTickInfo& TickInfo);
@@ -116,14 +286,20 @@ namespace ClientPrediction {
 
     private:
         bool CanSimBeCleanedUp(const FNetTickInfo& TickInfo);
-        void TrimStateBuffer();
 
     public:
         void TickPrePhysics(const FNetTickInfo& TickInfo, const InputType& Input);
-        void TickPostPhysics(const FNetTickInfo& TickInfo, const InputType& Input);
+
+        /** Runs the sim's post physics tick. @return true if the resulting state needs to be recorded with RecordPostPhysics(). */
+        bool TickPostPhysics(const FNetTickInfo& TickInfo, const InputType& Input);
+
+        /** Builds the state for the tick from the physics body and adds it to the history. Only reads the body. */
+        void RecordPostPhysics(const FNetTickInfo& TickInfo);
 
     private:
         void UpdateStateHistory(const FNetTickInfo& TickInfo, const WrappedState& State);
+        void PublishState(int32 HistoryTick, const WrappedState& State);
+        void ConsumePublishedStatesGT();
 
         bool IsSimOverPT(const FNetTickInfo& TickInfo);
         void EndSimIfNeeded(const FNetTickInfo& TickInfo);
@@ -137,29 +313,47 @@ namespace ClientPrediction {
         void InterpolateGameThread(UPrimitiveComponent* UpdatedComponent, Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, Chaos::FReal Dt, ENetRole SimRole);
 
     private:
-        void GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, WrappedState& OutState);
-        static Chaos::FRigidBodyHandle_Internal* GetPhysHandle(const FNetTickInfo& TickInfo);
+        void GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, bool bEvictPassedStates, WrappedState& OutState);
+        bool FindInterpolationEndTick(Chaos::FReal ResultsTime, int32& OutEndTick);
+        WrappedState* FindStateForServerTick(int32 ServerTick);
 
     public:
         const StateType& GetPrevState() { return PrevState.State; }
 
     private:
-        FCriticalSection StateMutex;
-        TArray<WrappedState> StateHistory;
-        int32 StateHistoryCapacity = INDEX_NONE;
+        struct FPublishedState {
+            int32 HistoryTick = INDEX_NONE;
+            WrappedState State{};
+        };
+
+        // Authorities and auto proxies key the histories by local tick, sim proxies by server tick since they don't simulate locally. The physics thread owns
+        // StateHistory and the game thread owns StateHistoryGT. Every state completed on the physics thread is handed over through PublishedStates, which is a
+        // lock-free single producer / single consumer ring, so neither thread ever has to wait on the other. It holds twice the history, since a resim can
+        // republish the whole history in one frame on top of the new states.
+        TTickHistory<WrappedState> StateHistory;
+        TTickHistory<WrappedState> StateHistoryGT;
+        TSpscRing<FPublishedState> PublishedStates;
 
         WrappedState PrevState{};
         WrappedState CurrentState{};
         WrappedState LastInterpolatedState{};
+        int32 InterpolationCursorTick = TNumericLimits<int32>::Min();
         TAtomic<bool> bGeneratedInitialState = false;
 
+        // The final state is only touched on the physics thread, the game thread learns about it when it is published as part of the history.
         TAtomic<bool> bEndedSimOnGameThread = false;
-        FCriticalSection FinalStateMutex;
         WrappedState FinalState{};
+        TOptional<WrappedState> FinalStateGT;
 
         // Relevant only for sim proxies
         ECollisionEnabled::Type CachedCollisionMode = ECollisionEnabled::NoCollision;
 
+        // Every state received by a sim proxy, keyed by server tick, so that later states can be decoded against them. Only accessed on the physics thread.
+        TTickHistory<DeltaState> SimProxyBaselines;
+
+        // Relevant only for the authority. The last sim proxy state that was emitted, which most connections hold as their baseline for the next bundle.
+        TSharedPtr<FStateBaseline> LastSimProxyState;
+
         // Relevant only for auto proxies
         WrappedState LatestAuthorityState{};
         int32 LatestAckedServerTick = INDEX_NONE;
@@ -183,52 +377,105 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::SetBufferSize(int32 BufferSize) {
-        StateHistoryCapacity = BufferSize;
+        StateHistory.SetCapacity(BufferSize);
+        StateHistoryGT.SetCapacity(BufferSize);
+        PublishedStates.SetCapacity(BufferSize * 2);
     }
 
     template <typename Traits>
-    void USimState<Traits>::ConsumeSimProxyStates(const FBundledPacketsLow& Packets, Chaos::FReal SimDt) {
-        FScopeLock StateLock(&StateMutex);
-        TArray<WrappedState> AuthorityStates;
-        Packets.Bundle().Retrieve(AuthorityStates, this);
+    void USimState<Traits>::ConsumeSimProxyStates(const FBundledPacketsDelta& Packets, Chaos::FReal SimDt) {
+        if (SimProxyBaselines.Capacity() == 0) {
+            SimProxyBaselines.SetCapacity(FMath::Max(ClientPredictionSimProxyHistoryTicks, 1));
+        }
 
-        for (WrappedState& NewState : AuthorityStates) {
-            if (StateHistory.ContainsByPredicate([&](const WrappedState& Other) { return Other.ServerTick == NewState.ServerTick; })) {
-                continue;
+        Packets.Retrieve([&](FArchive& Ar) { DecodeSimProxyStates(Ar, SimDt); });
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::DecodeSimProxyStates(FArchive& Ar, Chaos::FReal SimDt) {
+        uint32 NumStates = 0;
+        uint32 PackedFirstTick = 0;
+        uint8 bHasBaseline = 0;
+
+        Ar.SerializeIntPacked(NumStates);
+        Ar.SerializeIntPacked(PackedFirstTick);
+        Ar.SerializeBits(&bHasBaseline, 1);
+
+        int32 ServerTick = static_cast<int32>(PackedFirstTick) - 1;
+        DeltaState Previous{};
+
+        if (bHasBaseline != 0) {
+            uint32 BaselineAge = 0;
+            Ar.SerializeIntPacked(BaselineAge);
+
+            // The baseline was in a packet that was dropped. The authority goes back to a baseline we do have once it finds out, so this packet can be skipped.
+            const DeltaState* Baseline = SimProxyBaselines.Find(ServerTick - static_cast<int32>(BaselineAge));
+            if (Baseline == nullptr) { return; }
+
+            Previous = *Baseline;
+        }
+
+        for (uint32 StateIdx = 0; StateIdx < NumStates && !Ar.IsError(); ++StateIdx) {
+            if (StateIdx > 0) {
+                uint32 TickDelta = 0;
+                Ar.SerializeIntPacked(TickDelta);
+                ServerTick += static_cast<int32>(TickDelta);
             }
 
+            DeltaState Decoded{};
+            Decoded.ServerTick = ServerTick;
+            Decoded.NetSerialize(Ar, Previous);
+            if (Ar.IsError()) { return; }
+
+            SimProxyBaselines.Set(ServerTick, Decoded);
+
+            WrappedState NewState{};
+            NewState.ServerTick = ServerTick;
+            NewState.bIsFinalState = Decoded.bIsFinalState;
+            NewState.State = Decoded.State;
+            Decoded.PhysState.Dequantize(NewState.PhysState, TSimPhysQuantization<Traits>::Get());
+
+            // Sim proxies only interpolate, so the states go straight to the game thread. They are merged in by server tick there.
             UpdateTimesRecvSimProxy(NewState, SimDt);
-            StateHistory.Add(MoveTemp(NewState));
+            PublishState(NewState.ServerTick, NewState);
+
+            Previous = MoveTemp(Decoded);
         }
+    }
 
-        StateHistory.Sort([](const WrappedState& Lhs, const WrappedState& Rhs) { return Lhs.ServerTick < Rhs.ServerTick; });
+    template <typename Traits>
+    typename USimState<Traits>::DeltaState USimState<Traits>::MakeDeltaState(const WrappedState& State) {
+        DeltaState Delta{};
+        Delta.ServerTick = State.ServerTick;
+        Delta.bIsFinalState = State.bIsFinalState;
+        Delta.State = State.State;
+        Delta.PhysState = FQuantizedPhysState::Quantize(State.PhysState, TSimPhysQuantization<Traits>::Get());
+
+        return Delta;
     }
 
     template <typename Traits>
     void USimState<Traits>::ConsumeAutoProxyStates(const FBundledPacketsFull& Packets) {
-        TArray<WrappedState> AuthorityStates;
-        Packets.Bundle().Retrieve(AuthorityStates, this);
+        TScopedScratch<TArray<WrappedState>> AuthorityStates;
+        Packets.Bundle().Retrieve(*AuthorityStates, &TSimPhysQuantization<Traits>::Get());
 
-        if (AuthorityStates.IsEmpty() || AuthorityStates.Last().ServerTick <= LatestAuthorityState.ServerTick) { return; }
-        LatestAuthorityState = AuthorityStates.Last();
+        if (AuthorityStates->IsEmpty() || AuthorityStates->Last().ServerTick <= LatestAuthorityState.ServerTick) { return; }
+        LatestAuthorityState = AuthorityStates->Last();
     }
 
     template <typename Traits>
     void USimState<Traits>::ConsumeFinalState(const FBundledPacketsFull& Packets, const FNetTickInfo& TickInfo) {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        FScopeLock StateLock(&StateMutex);
+        TScopedScratch<TArray<WrappedState>> AuthorityState;
+        Packets.Bundle().Retrieve(*AuthorityState, &TSimPhysQuantization<Traits>::Get());
 
-        TArray<WrappedState> AuthorityState;
-        Packets.Bundle().Retrieve(AuthorityState, this);
-
-        check(AuthorityState.Num() == 1);
-        FinalState = AuthorityState[0];
+        check(AuthorityState->Num() == 1);
+        FinalState = (*AuthorityState)[0];
 
         if (TickInfo.SimRole == ROLE_SimulatedProxy) {
             UpdateTimesRecvSimProxy(FinalState, TickInfo.Dt);
 
-            // The final state should always be the last. Plus we sort in ConsumeSimProxyStates() so it shouldn't be a problem if another state is received after.
-            StateHistory.Add(FinalState);
+            // The final state should always be the last. The history is keyed by server tick so it shouldn't be a problem if another state is received after.
+            PublishState(FinalState.ServerTick, FinalState);
             return;
         }
 
@@ -260,7 +507,7 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::FillStatePhysInfo(WrappedState& State, const FNetTickInfo& TickInfo) {
-        const Chaos::FRigidBodyHandle_Internal* Handle = GetPhysHandle(TickInfo);
+        const Chaos::FRigidBodyHandle_Internal* Handle = TickInfo.PhysHandle;
         if (Handle == nullptr) {
             State.PhysState.ObjectState = Chaos::EObjectStateType::Uninitialized;
             return;
@@ -277,13 +524,12 @@ namespace ClientPrediction {
     void USimState<Traits>::GenerateInitialState(const FNetTickInfo& TickInfo) {
         if (SimDelegates == nullptr) { return; }
 
-        FScopeLock StateLock(&StateMutex);
-
         // We can leave the frame indexes and times as invalid because this is just a starting off point until we get the first valid frame
         USimState::FillStatePhysInfo(CurrentState, TickInfo);
         SimDelegates->GenerateInitialStatePTDelegate.Broadcast(CurrentState.State);
 
-        StateHistory.Add(CurrentState);
+        StateHistory.Set(INDEX_NONE, CurrentState);
+        PublishState(INDEX_NONE, CurrentState);
     }
 
     template <typename Traits>
@@ -302,25 +548,12 @@ namespace ClientPrediction {
             return bEndedSimOnGameThread ? ESimStage::kEnded : ESimStage::kRunning;
         }
 
-        // We need to unlock the state mutex before checking if the sim is over to prevent deadlock since everything is done final state then state lock.
-        {
-            FScopeLock StateLock(&StateMutex);
-            TrimStateBuffer();
-        }
-
         if (IsSimOverPT(TickInfo)) {
             return ESimStage::kEnded;
         }
 
-        FScopeLock StateLock(&StateMutex);
-        ApplyCorrectionIfNeeded(TickInfo);
-
-        const int32 PrevTickNumber = TickInfo.LocalTick - 1;
-        for (const WrappedState& State : StateHistory) {
-            if (State.LocalTick > PrevTickNumber) { break; }
-
-            PrevState = State;
-            if (State.LocalTick == PrevTickNumber) { break; }
+        if (const WrappedState* State = StateHistory.FindAtOrBefore(TickInfo.LocalTick - 1)) {
+            PrevState = *State;
         }
 
         return ESimStage::kRunning;
@@ -334,19 +567,9 @@ namespace ClientPrediction {
             return true;
         }
 
-        FScopeLock FinalStateLock(&FinalStateMutex);
         return FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick > FinalState.LocalTick + StateHistory.Num();
     }
 
-    template <typename Traits>
-    void USimState<Traits>::TrimStateBuffer() {
-        if (StateHistoryCapacity == INDEX_NONE) { return; }
-
-        while (StateHistory.Num() > StateHistoryCapacity) {
-            StateHistory.RemoveAt(0, EAllowShrinking::No);
-        }
-    }
-
     template <typename Traits>
     void USimState<Traits>::TickPrePhysics(const FNetTickInfo& TickInfo, const InputType& Input) {
         if (SimDelegates == nullptr || TickInfo.SimRole == ROLE_SimulatedProxy) { return; }
@@ -363,45 +586,63 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    void USimState<Traits>::TickPostPhysics(const FNetTickInfo& TickInfo, const InputType& Input) {
-        if (SimDelegates == nullptr || TickInfo.SimRole == ROLE_SimulatedProxy) { return; }
+    bool USimState<Traits>::TickPostPhysics(const FNetTickInfo& TickInfo, const InputType& Input) {
+        if (SimDelegates == nullptr || TickInfo.SimRole == ROLE_SimulatedProxy) { return false; }
 
         if (IsSimOverPT(TickInfo)) {
-            return;
+            return false;
         }
 
         FTickOutput Output(CurrentState.State, TickInfo, SimEvents);
         SimDelegates->SimTickPostPhysicsDelegate.Broadcast(TickInfo, Input, PrevState.State, Output);
-        USimState::FillStateSimDetails(CurrentState, TickInfo);
 
+        return true;
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::RecordPostPhysics(const FNetTickInfo& TickInfo) {
+        USimState::FillStateSimDetails(CurrentState, TickInfo);
         UpdateStateHistory(TickInfo, CurrentState);
     }
 
     template <typename Traits>
     void USimState<Traits>::UpdateStateHistory(const FNetTickInfo& TickInfo, const WrappedState& State) {
-        FScopeLock StateLock(&StateMutex);
-        if (StateHistory.IsEmpty() || StateHistory.Last().LocalTick < TickInfo.LocalTick) {
-            StateHistory.Add(State);
+        if (StateHistory.Set(TickInfo.LocalTick, State) == nullptr) {
             return;
         }
 
-        for (int32 StateIdx = 0; StateIdx < StateHistory.Num(); ++StateIdx) {
-            WrappedState& HistoricState = StateHistory[StateIdx];
-            if (HistoricState.LocalTick != TickInfo.LocalTick) {
-                continue;
-            }
+        PublishState(TickInfo.LocalTick, State);
+        if (!State.bIsFinalState) {
+            return;
+        }
 
-            HistoricState = State;
-            if (!State.bIsFinalState) {
-                return;
-            }
+        // Auto proxies were probably ahead of the authority, so there were most likely states that were predicted after the end of the simulation.
+        // These states never actually happened on the authority , so we want to remove them.
+        StateHistory.RemoveAfter(TickInfo.LocalTick);
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::PublishState(int32 HistoryTick, const WrappedState& State) {
+        // Nothing reads the states once the game thread has presented the final one.
+        if (bEndedSimOnGameThread) { return; }
 
-            // Auto proxies were probably ahead of the authority, so there were most likely states that were predicted after the end of the simulation.
-            // These states never actually happened on the authority , so we want to remove them.
-            const int32 NextStateIdx = StateIdx + 1;
-            while (StateHistory.Num() > NextStateIdx) {
-                StateHistory.RemoveAt(NextStateIdx);
+        if (!PublishedStates.Enqueue({HistoryTick, State})) {
+            UE_LOG(LogClientPrediction, Warning, TEXT("Dropped a state for tick %d because the game thread hasn't consumed the published states"), HistoryTick);
+        }
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::ConsumePublishedStatesGT() {
+        FPublishedState Published;
+        while (PublishedStates.Dequeue(Published)) {
+            // States that are older than the window or that the sim proxy interpolation has already moved past are rejected by the history.
+            if (StateHistoryGT.Set(Published.HistoryTick, Published.State) == nullptr || !Published.State.bIsFinalState) {
+                continue;
             }
+
+            // Mirrors the physics thread history, anything predicted after the final state never happened.
+            StateHistoryGT.RemoveAfter(Published.HistoryTick);
+            FinalStateGT = Published.State;
         }
     }
 
@@ -409,14 +650,11 @@ namespace ClientPrediction {
     bool USimState<Traits>::IsSimOverPT(const FNetTickInfo& TickInfo) {
         // Auto proxies assign a local tick when the final state is consumed to avoid a changing server offset causing the simulation to report as not over for a few ticks.
         // Authorities can just use the local tick because for them LocalTick == ServerTick.
-        FScopeLock FinalStateLock(&FinalStateMutex);
         return FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick >= FinalState.LocalTick;
     }
 
     template <typename Traits>
     void USimState<Traits>::EndSimIfNeeded(const FNetTickInfo& TickInfo) {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-
         if (TickInfo.SimRole == ROLE_AutonomousProxy && FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick >= FinalState.LocalTick) {
             if (bAutoProxyAppliedFinalState) { return; }
             bAutoProxyAppliedFinalState = true;
@@ -453,7 +691,7 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::EndSimPT(const FNetTickInfo& TickInfo) {
-        Chaos::FRigidBodyHandle_Internal* Handle = GetPhysHandle(TickInfo);
+        Chaos::FRigidBodyHandle_Internal* Handle = TickInfo.PhysHandle;
         if (Handle == nullptr) { return; }
 
         Handle->SetX(FinalState.PhysState.X);
@@ -473,22 +711,17 @@ namespace ClientPrediction {
         Chaos::FRewindData* RewindData = PhysSolver->GetRewindData();
         if (RewindData == nullptr) { return INDEX_NONE; }
 
-        FScopeLock StateLock(&StateMutex);
-        WrappedState* HistoricState = nullptr;
-
-        for (WrappedState& State : StateHistory) {
-            if (State.ServerTick == LatestAuthorityState.ServerTick) {
-                HistoricState = &State;
-
-                break;
-            }
-        }
-
+        WrappedState* HistoricState = FindStateForServerTick(LatestAuthorityState.ServerTick);
         if (HistoricState == nullptr) {
             return INDEX_NONE;
         }
 
-        if (!HistoricState->PhysState.ShouldReconcile(LatestAuthorityState.PhysState) && !HistoricState->State.ShouldReconcile(LatestAuthorityState.State)) {
+        // The authority state went through the quantization when it was sent, so the predicted state goes through it too before they are compared.
+        // Otherwise the quantization error alone could trigger a resim.
+        FPhysState PredictedPhysState = HistoricState->PhysState;
+        TSimPhysQuantization<Traits>::Get().Quantize(PredictedPhysState, EDataCompleteness::kFull);
+
+        if (!PredictedPhysState.ShouldReconcile(LatestAuthorityState.PhysState) && !TSchemaOps<StateType>::ShouldReconcile(HistoricState->State, LatestAuthorityState.State)) {
             return INDEX_NONE;
         }
 
@@ -506,6 +739,7 @@ namespace ClientPrediction {
 
         HistoricState->PhysState = LatestAuthorityState.PhysState;
         HistoricState->State = LatestAuthorityState.State;
+        PublishState(HistoricState->LocalTick, *HistoricState);
 
         Chaos::FReadPhysicsObjectInterface_Internal Interface = Chaos::FPhysicsObjectInternalInterface::GetRead();
         if (Chaos::FPBDRigidParticleHandle* ParticleHandle = Interface.GetRigidParticle(PhysObject)) {
@@ -521,9 +755,9 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::ApplyCorrectionIfNeeded(const FNetTickInfo& TickInfo) {
-        if (!PendingCorrection.IsSet() || PendingCorrection->LocalTick != TickInfo.LocalTick) { return; }
+        if (!PendingCorrection.IsSet() || PendingCorrection->LocalTick != TickInfo.LocalTick || IsSimOverPT(TickInfo)) { return; }
 
-        Chaos::FRigidBodyHandle_Internal* Handle = GetPhysHandle(TickInfo);
+        Chaos::FRigidBodyHandle_Internal* Handle = TickInfo.PhysHandle;
         if (Handle == nullptr) { return; }
 
         const FPhysState& PhysState = PendingCorrection->PhysState;
@@ -539,51 +773,69 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::EmitStates() {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        FScopeLock StateLock(&StateMutex);
+        ConsumePublishedStatesGT();
 
-        if (StateHistory.IsEmpty() || StateHistory.Last().ServerTick <= LatestEmittedTick) {
+        if (StateHistoryGT.IsEmpty() || StateHistoryGT.Last().ServerTick <= LatestEmittedTick) {
             return;
         }
 
-        if (FinalState.ServerTick != INDEX_NONE) {
+        if (FinalStateGT.IsSet()) {
             FBundledPacketsFull FinalStatePacket{};
-            TArray<WrappedState> FinalStateArr = {FinalState};
+            TScopedScratch<TArray<WrappedState>> FinalStateArr;
+            FinalStateArr->Add(FinalStateGT.GetValue());
 
-            FinalStatePacket.Bundle().Store(FinalStateArr, this);
+            FinalStatePacket.Bundle().Store(*FinalStateArr, &TSimPhysQuantization<Traits>::Get());
             EmitFinalBundle.ExecuteIfBound(FinalStatePacket);
 
             LatestEmittedTick = TNumericLimits<int32>::Max();
             return;
         }
 
+        // The authority's local tick is the server tick, so only the ticks that haven't been emitted yet need to be visited.
+        const int32 FirstUnemittedTick = FMath::Max(StateHistoryGT.OldestTick(), LatestEmittedTick + 1);
+
         // Auto proxies predict so they don't need every single state to be sent. We go backwards and find the one that matches the send interval that hasn't already been
         // emitted.
-        for (int32 StateIdx = StateHistory.Num() - 1; StateIdx >= 0; --StateIdx) {
-            if (StateHistory[StateIdx].ServerTick <= LatestEmittedTick) { break; }
-            if (StateHistory[StateIdx].ServerTick % ClientPredictionAutoProxySendInterval != 0) { continue; }
+        for (int32 Tick = StateHistoryGT.NewestTick(); Tick >= FirstUnemittedTick; --Tick) {
+            const WrappedState* State = StateHistoryGT.Find(Tick);
+            if (State == nullptr || State->ServerTick % ClientPredictionAutoProxySendInterval != 0) { continue; }
 
             FBundledPacketsFull AutoProxyPackets{};
-            TArray<WrappedState> AutoProxyStates{StateHistory[StateIdx]};
+            TScopedScratch<TArray<WrappedState>> AutoProxyStates;
+            AutoProxyStates->Add(*State);
 
-            AutoProxyPackets.Bundle().Store(AutoProxyStates, this);
+            AutoProxyPackets.Bundle().Store(*AutoProxyStates, &TSimPhysQuantization<Traits>::Get());
             EmitAutoProxyBundle.ExecuteIfBound(AutoProxyPackets);
         }
 
-        TArray<WrappedState> SimProxyStates;
-        for (const WrappedState& State : StateHistory) {
-            if (State.ServerTick > LatestEmittedTick && State.ServerTick % ClientPredictionSimProxySendInterval == 0) {
-                SimProxyStates.Add(State);
+        using FSimProxyStateEncoder = TSimProxyStateEncoder<StateType>;
+        TSharedRef<FSimProxyStateEncoder, ESPMode::ThreadSafe> Encoder = TSharedObjectPool<FSimProxyStateEncoder>::Acquire();
+        Encoder->States.Reset();
+
+        for (int32 Tick = FirstUnemittedTick; Tick <= StateHistoryGT.NewestTick(); ++Tick) {
+            const WrappedState* State = StateHistoryGT.Find(Tick);
+            if (State != nullptr && State->ServerTick % ClientPredictionSimProxySendInterval == 0) {
+                Encoder->States.Add(MakeDeltaState(*State));
             }
         }
 
-        if (!SimProxyStates.IsEmpty()) {
-            FBundledPacketsLow SimProxyPackets{};
-            SimProxyPackets.Bundle().Store(SimProxyStates, this);
+        // Sim proxy states are encoded separately for every connection against the last state that connection was sent, so only the encoder is stored here.
+        if (!Encoder->States.IsEmpty()) {
+            TSharedRef<DeltaState, ESPMode::ThreadSafe> LastState = TSharedObjectPool<DeltaState>::Acquire();
+            *LastState = Encoder->States.Last();
+            Encoder->LastState = LastState;
+
+            Encoder->PreviousLastState = LastSimProxyState;
+            Encoder->BuildUnchangedStates();
+            LastSimProxyState = LastState;
+
+            FBundledPacketsDelta SimProxyPackets{};
+            SimProxyPackets.SetEncoder(Encoder);
+
             EmitSimProxyBundle.ExecuteIfBound(SimProxyPackets);
         }
 
-        LatestEmittedTick = StateHistory.Last().ServerTick;
+        LatestEmittedTick = StateHistoryGT.Last().ServerTick;
     }
 
     template <typename Traits>
@@ -591,8 +843,12 @@ namespace ClientPrediction {
                                                   ENetRole SimRole) {
         if (UpdatedComponent == nullptr || SimDelegates == nullptr || !bGeneratedInitialState || bEndedSimOnGameThread) { return; }
 
+        // Nothing to present until the physics thread has published the initial state.
+        ConsumePublishedStatesGT();
+        if (StateHistoryGT.IsEmpty()) { return; }
+
         Chaos::FReal AdjustedResultsTime = SimRole != ROLE_SimulatedProxy ? ResultsTime : ResultsTime + SimProxyOffset;
-        GetInterpolatedStateAtTime(AdjustedResultsTime, LastInterpolatedState);
+        GetInterpolatedStateAtTime(AdjustedResultsTime, SimRole == ROLE_SimulatedProxy, LastInterpolatedState);
 
         FBodyInstance* BodyInstance = UpdatedComponent->GetBodyInstance();
         if (BodyInstance == nullptr) { return; }
@@ -628,49 +884,60 @@ namespace ClientPrediction {
 
 
         SimDelegates->FinalizeDelegate.Broadcast(LastInterpolatedState.State, Dt);
-        bEndedSimOnGameThread |= LastInterpolatedState.bIsFinalState;
+        if (LastInterpolatedState.bIsFinalState) {
+            bEndedSimOnGameThread = true;
+            PublishedStates.Discard();
+        }
     }
 
     template <typename Traits>
-    void USimState<Traits>::GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, WrappedState& OutState) {
-        FScopeLock StateLock(&StateMutex);
-
-        if (StateHistory.IsEmpty()) {
+    void USimState<Traits>::GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, bool bEvictPassedStates, WrappedState& OutState) {
+        if (StateHistoryGT.IsEmpty()) {
             OutState = LastInterpolatedState;
             return;
         }
 
-        for (int StateIndex = 0; StateIndex < StateHistory.Num(); StateIndex++) {
-            if (StateHistory[StateIndex].EndTime < ResultsTime) { continue; }
+        int32 EndTick = INDEX_NONE;
+        if (FindInterpolationEndTick(ResultsTime, EndTick)) {
+            const WrappedState& End = *StateHistoryGT.Find(EndTick);
 
-            if (StateIndex == 0) {
-                OutState = StateHistory[0];
+            int32 StartTick = INDEX_NONE;
+            const WrappedState* StartPtr = StateHistoryGT.FindAtOrBefore(EndTick - 1, &StartTick);
+            if (StartPtr == nullptr) {
+                OutState = End;
                 return;
             }
 
-            const WrappedState& Start = StateHistory[StateIndex - 1];
-            const WrappedState& End = StateHistory[StateIndex];
-            OutState = Start;
-
             // This mostly mirrors the Chaos interpolation algorithm except we use the end time of the start state, rather than the end time of the end state.
             // This is because for sim proxies the state buffer might not have every tick in it and this will handle it more gracefully.
+            const WrappedState& Start = *StartPtr;
             const Chaos::FReal Denominator = End.EndTime - Start.EndTime;
             const Chaos::FReal Alpha = Denominator != 0.0 ? FMath::Min(1.0, (ResultsTime - Start.EndTime) / Denominator) : 1.0;
-            OutState.Interpolate(End, Alpha);
+            OutState.InterpolateForGameThread(Start, End, Alpha);
+
+            // Sim proxies only ever interpolate forward, so anything before the start state is never going to be used again.
+            if (bEvictPassedStates) {
+                StateHistoryGT.RemoveBefore(StartTick);
+            }
 
             return;
         }
 
-        OutState = StateHistory.Last();
+        OutState = StateHistoryGT.Last();
 
-        if (StateHistory.Num() == 1 || OutState.bIsFinalState) {
+        if (StateHistoryGT.Num() == 1 || OutState.bIsFinalState) {
             return;
         }
 
         const Chaos::FReal ExtrapolationTime = ResultsTime - OutState.EndTime;
         if (ExtrapolationTime == 0.0) { return; }
 
-        const WrappedState& PrevExtrapolationState = StateHistory[StateHistory.Num() - 2];
+        const WrappedState& PrevExtrapolationState = *StateHistoryGT.FindAtOrBefore(StateHistoryGT.NewestTick() - 1);
+        if (bEvictPassedStates) {
+            // Sim proxies key their history by server tick. The last two states are kept since they are needed to keep extrapolating.
+            StateHistoryGT.RemoveBefore(PrevExtrapolationState.ServerTick);
+        }
+
         const Chaos::FReal StateDt = OutState.EndTime - PrevExtrapolationState.EndTime;
         if (StateDt <= 0.0) { return; }
 
@@ -682,10 +949,77 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    Chaos::FRigidBodyHandle_Internal* USimState<Traits>::GetPhysHandle(const FNetTickInfo& TickInfo) {
-        FBodyInstance* BodyInstance = TickInfo.UpdatedComponent->GetBodyInstance();
-        if (BodyInstance == nullptr) { return nullptr; }
+    bool USimState<Traits>::FindInterpolationEndTick(Chaos::FReal ResultsTime, int32& OutEndTick) {
+        const int32 OldestTick = StateHistoryGT.OldestTick();
+        const int32 NewestTick = StateHistoryGT.NewestTick();
+
+        // The results time only moves backwards after a correction, so the search almost always continues from where the last one ended and only moves a state or two.
+        if (InterpolationCursorTick >= OldestTick && InterpolationCursorTick <= NewestTick) {
+            const WrappedState* CursorPrevState = StateHistoryGT.FindAtOrBefore(InterpolationCursorTick - 1);
+            if (CursorPrevState == nullptr || CursorPrevState->EndTime < ResultsTime) {
+                for (int32 Tick = InterpolationCursorTick; Tick <= NewestTick; ++Tick) {
+                    const WrappedState* State = StateHistoryGT.Find(Tick);
+                    if (State == nullptr || State->EndTime < ResultsTime) { continue; }
+
+                    InterpolationCursorTick = OutEndTick = Tick;
+                    return true;
+                }
+
+                InterpolationCursorTick = NewestTick;
+                return false;
+            }
+        }
+
+        // Otherwise bisect the tick range for the first state that ends at or after the results time. Not every tick has a state, so a probe that lands in a
+        // gap moves forward to the next state, but never past the upper bound. With a dense history this is logarithmic. With gaps, the scans of each round
+        // are bounded by half of the remaining range, so the whole search never visits more slots than a single linear scan would.
+        int32 Low = OldestTick;
+        int32 High = NewestTick + 1;
+        while (Low < High) {
+            const int32 Mid = Low + (High - Low) / 2;
+
+            int32 ProbeTick = Mid;
+            const WrappedState* ProbeState = StateHistoryGT.Find(ProbeTick);
+            while (ProbeState == nullptr && ++ProbeTick < High) {
+                ProbeState = StateHistoryGT.Find(ProbeTick);
+            }
+
+            if (ProbeState == nullptr || ProbeState->EndTime >= ResultsTime) {
+                High = Mid;
+            }
+            else {
+                Low = ProbeTick + 1;
+            }
+        }
+
+        InterpolationCursorTick = NewestTick;
+        if (StateHistoryGT.FindAtOrAfter(Low, &OutEndTick) == nullptr) {
+            return false;
+        }
+
+        InterpolationCursorTick = OutEndTick;
+        return true;
+    }
+
+    template <typename Traits>
+    typename USimState<Traits>::WrappedState* USimState<Traits>::FindStateForServerTick(int32 ServerTick) {
+        if (StateHistory.IsEmpty()) { return nullptr; }
+
+        // The history is keyed by local tick, so the latest offset between the local and server tick is used to guess where the state is. The offset is very
+        // rarely different from when the state was generated, so the fallback scan is almost never needed.
+        const WrappedState& NewestState = StateHistory.Last();
+        WrappedState* State = StateHistory.Find(ServerTick - (NewestState.ServerTick - NewestState.LocalTick));
+        if (State != nullptr && State->ServerTick == ServerTick) {
+            return State;
+        }
+
+        for (int32 Tick = StateHistory.NewestTick(); Tick >= StateHistory.OldestTick(); --Tick) {
+            State = StateHistory.Find(Tick);
+            if (State != nullptr && State->ServerTick == ServerTick) {
+                return State;
+            }
+        }
 
-        return BodyInstance->GetPhysicsActorHandle()->GetPhysicsThreadAPI();
+        return nullptr;
     }
 }
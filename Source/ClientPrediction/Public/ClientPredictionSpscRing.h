@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+namespace ClientPrediction {
+    /**
+     * A fixed capacity, lock-free queue between one producer thread and one consumer thread. Slots are allocated once by SetCapacity(), so enqueueing and
+     * dequeueing never allocate. When the queue is full, new elements are refused rather than growing it.
+     */
+    template <typename ElementType>
+    class TSpscRing {
+    public:
+        /** Not thread safe. Must be called before either thread uses the queue. Discards anything in the queue. */
+        void SetCapacity(int32 NewCapacity);
+        int32 Capacity() const { return Slots.Num(); }
+
+        /** Called on the producer thread. @return false if the queue is full and the element was dropped. */
+        bool Enqueue(const ElementType& Element);
+
+        /** Called on the consumer thread. */
+        bool Dequeue(ElementType& OutElement);
+
+        /** Called on the consumer thread. Drops everything currently in the queue. */
+        void Discard();
+
+    private:
+        TArray<ElementType> Slots;
+
+        // Both only ever increase. The producer owns Tail and the consumer owns Head, each only reads the other's.
+        TAtomic<uint32> Head = 0;
+        TAtomic<uint32> Tail = 0;
+    };
+
+    template <typename ElementType>
+    void TSpscRing<ElementType>::SetCapacity(int32 NewCapacity) {
+        check(NewCapacity > 0);
+
+        Slots.Reset();
+        Slots.SetNum(NewCapacity);
+
+        Head = 0;
+        Tail = 0;
+    }
+
+    template <typename ElementType>
+    bool TSpscRing<ElementType>::Enqueue(const ElementType& Element) {
+        const uint32 CurrentTail = Tail.Load(EMemoryOrder::Relaxed);
+        if (Slots.IsEmpty() || CurrentTail - Head.Load() >= static_cast<uint32>(Slots.Num())) { return false; }
+
+        Slots[CurrentTail % static_cast<uint32>(Slots.Num())] = Element;
+        Tail = CurrentTail + 1;
+
+        return true;
+    }
+
+    template <typename ElementType>
+    bool TSpscRing<ElementType>::Dequeue(ElementType& OutElement) {
+        const uint32 CurrentHead = Head.Load(EMemoryOrder::Relaxed);
+        if (CurrentHead == Tail.Load()) { return false; }
+
+        OutElement = Slots[CurrentHead % static_cast<uint32>(Slots.Num())];
+        Head = CurrentHead + 1;
+
+        return true;
+    }
+
+    template <typename ElementType>
+    void TSpscRing<ElementType>::Discard() {
+        Head = Tail.Load();
+    }
+}
@@ -4,6 +4,10 @@
 
 class AClientPredictionSimProxyManager;
 
+namespace Chaos {
+    class FRigidBodyHandle_Internal;
+}
+
 namespace ClientPrediction {
     struct FTickInfo {
         int32 LocalTick = INDEX_NONE;
@@ -20,6 +24,7 @@ namespace ClientPrediction {
         Chaos::FReal EndTime = 0.0;
 
         class UPrimitiveComponent* UpdatedComponent = nullptr;
+        Chaos::FRigidBodyHandle_Internal* PhysHandle = nullptr;
         AClientPredictionSimProxyManager* SimProxyWorldManager = nullptr;
         ENetRole SimRole = ROLE_None;
     };
@@ -0,0 +1,220 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+namespace ClientPrediction {
+    /**
+     * A fixed capacity history of elements keyed by tick. Every tick maps directly to a slot in a circular buffer, so adding, finding and removing an element
+     * are all O(1). Only the latest Capacity() ticks are retained: setting a tick newer than the newest one evicts everything that falls out of that window.
+     */
+    template <typename ElementType>
+    class TTickHistory {
+    public:
+        void SetCapacity(int32 NewCapacity);
+        int32 Capacity() const { return Slots.Num(); }
+
+        int32 Num() const { return NumElements; }
+        bool IsEmpty() const { return NumElements == 0; }
+
+        /** The range of ticks that the history can currently hold. Not every tick in the range necessarily has an element. Only valid if the history isn't empty. */
+        int32 OldestTick() const { return FMath::Max(NewestTick() - Capacity() + 1, Floor); }
+        int32 NewestTick() const { return Newest; }
+
+        ElementType* Find(int32 Tick);
+        const ElementType* Find(int32 Tick) const;
+
+        /** Finds the element for the tick or, if there is no element for it, the newest element before it. The tick of the element is written to OutTick. */
+        ElementType* FindAtOrBefore(int32 Tick, int32* OutTick = nullptr);
+
+        /** Finds the element for the tick or, if there is no element for it, the oldest element after it. The tick of the element is written to OutTick. */
+        ElementType* FindAtOrAfter(int32 Tick, int32* OutTick = nullptr);
+
+        ElementType& Last();
+        const ElementType& Last() const;
+
+        /**
+         * Sets the element for a tick. If the tick is newer than the newest tick, the window is advanced and elements that fall out of it are evicted.
+         * @return The stored element or nullptr if the tick is older than the window or was already removed with RemoveBefore().
+         */
+        ElementType* Set(int32 Tick, const ElementType& Element);
+
+        /** Removes every element newer than the tick. */
+        void RemoveAfter(int32 Tick);
+
+        /** Removes every element older than the tick. Elements for those ticks won't be accepted by Set() anymore. */
+        void RemoveBefore(int32 Tick);
+
+        void Reset();
+
+    private:
+        static constexpr int32 kInvalidTick = TNumericLimits<int32>::Min();
+
+        struct FSlot {
+            int32 Tick = kInvalidTick;
+            ElementType Element{};
+        };
+
+        int32 SlotIndex(int32 Tick) const;
+        void RemoveSlot(int32 Tick);
+
+        TArray<FSlot> Slots;
+        int32 NumElements = 0;
+        int32 Newest = kInvalidTick;
+        int32 Floor = kInvalidTick;
+    };
+
+    template <typename ElementType>
+    void TTickHistory<ElementType>::SetCapacity(int32 NewCapacity) {
+        check(NewCapacity > 0);
+
+        Slots.Reset();
+        Slots.SetNum(NewCapacity);
+
+        NumElements = 0;
+        Newest = kInvalidTick;
+        Floor = kInvalidTick;
+    }
+
+    template <typename ElementType>
+    ElementType* TTickHistory<ElementType>::Find(int32 Tick) {
+        if (IsEmpty() || Tick > Newest || Tick < OldestTick()) { return nullptr; }
+
+        FSlot& Slot = Slots[SlotIndex(Tick)];
+        return Slot.Tick == Tick ? &Slot.Element : nullptr;
+    }
+
+    template <typename ElementType>
+    const ElementType* TTickHistory<ElementType>::Find(int32 Tick) const {
+        return const_cast<TTickHistory*>(this)->Find(Tick);
+    }
+
+    template <typename ElementType>
+    ElementType* TTickHistory<ElementType>::FindAtOrBefore(int32 Tick, int32* OutTick) {
+        if (IsEmpty()) { return nullptr; }
+
+        const int32 OldestValidTick = OldestTick();
+        for (int32 CandidateTick = FMath::Min(Tick, Newest); CandidateTick >= OldestValidTick; --CandidateTick) {
+            FSlot& Slot = Slots[SlotIndex(CandidateTick)];
+            if (Slot.Tick != CandidateTick) { continue; }
+
+            if (OutTick != nullptr) { *OutTick = CandidateTick; }
+            return &Slot.Element;
+        }
+
+        return nullptr;
+    }
+
+    template <typename ElementType>
+    ElementType* TTickHistory<ElementType>::FindAtOrAfter(int32 Tick, int32* OutTick) {
+        if (IsEmpty()) { return nullptr; }
+
+        for (int32 CandidateTick = FMath::Max(Tick, OldestTick()); CandidateTick <= Newest; ++CandidateTick) {
+            FSlot& Slot = Slots[SlotIndex(CandidateTick)];
+            if (Slot.Tick != CandidateTick) { continue; }
+
+            if (OutTick != nullptr) { *OutTick = CandidateTick; }
+            return &Slot.Element;
+        }
+
+        return nullptr;
+    }
+
+    template <typename ElementType>
+    ElementType& TTickHistory<ElementType>::Last() {
+        check(!IsEmpty());
+        return Slots[SlotIndex(Newest)].Element;
+    }
+
+    template <typename ElementType>
+    const ElementType& TTickHistory<ElementType>::Last() const {
+        check(!IsEmpty());
+        return Slots[SlotIndex(Newest)].Element;
+    }
+
+    template <typename ElementType>
+    ElementType* TTickHistory<ElementType>::Set(int32 Tick, const ElementType& Element) {
+        if (Slots.IsEmpty() || Tick < Floor) { return nullptr; }
+
+        if (IsEmpty()) {
+            Newest = Tick;
+        }
+        else if (Tick > Newest) {
+            // Evict everything that falls out of the window. Slots are shared between ticks that are Capacity() apart, so this never visits more than Capacity() slots.
+            const int32 OldWindowStart = Newest - Capacity() + 1;
+            const int32 NumToEvict = static_cast<int32>(FMath::Min<int64>(static_cast<int64>(Tick) - Newest, Capacity()));
+            for (int32 EvictIdx = 0; EvictIdx < NumToEvict; ++EvictIdx) {
+                RemoveSlot(OldWindowStart + EvictIdx);
+            }
+
+            Newest = Tick;
+        }
+        else if (Tick < OldestTick()) {
+            return nullptr;
+        }
+
+        FSlot& Slot = Slots[SlotIndex(Tick)];
+        if (Slot.Tick != Tick) {
+            Slot.Tick = Tick;
+            ++NumElements;
+        }
+
+        Slot.Element = Element;
+        return &Slot.Element;
+    }
+
+    template <typename ElementType>
+    void TTickHistory<ElementType>::RemoveAfter(int32 Tick) {
+        if (IsEmpty() || Tick >= Newest) { return; }
+
+        const int32 OldestValidTick = OldestTick();
+        while (Newest > Tick && Newest >= OldestValidTick) {
+            RemoveSlot(Newest--);
+        }
+
+        // The newest tick needs to point at an element, so skip back over any gaps.
+        while (NumElements > 0 && Slots[SlotIndex(Newest)].Tick != Newest) {
+            --Newest;
+        }
+    }
+
+    template <typename ElementType>
+    void TTickHistory<ElementType>::RemoveBefore(int32 Tick) {
+        if (Tick <= Floor) { return; }
+
+        if (!IsEmpty()) {
+            const int32 OldestValidTick = OldestTick();
+            const int32 LastTickToRemove = FMath::Min(Tick - 1, Newest);
+            for (int32 RemovedTick = OldestValidTick; RemovedTick <= LastTickToRemove; ++RemovedTick) {
+                RemoveSlot(RemovedTick);
+            }
+        }
+
+        Floor = Tick;
+    }
+
+    template <typename ElementType>
+    void TTickHistory<ElementType>::Reset() {
+        for (FSlot& Slot : Slots) {
+            Slot.Tick = kInvalidTick;
+        }
+
+        NumElements = 0;
+        Newest = kInvalidTick;
+        Floor = kInvalidTick;
+    }
+
+    template <typename ElementType>
+    int32 TTickHistory<ElementType>::SlotIndex(int32 Tick) const {
+        const int32 BufferSize = Slots.Num();
+        return (Tick % BufferSize + BufferSize) % BufferSize;
+    }
+
+    template <typename ElementType>
+    void TTickHistory<ElementType>::RemoveSlot(int32 Tick) {
+        FSlot& Slot = Slots[SlotIndex(Tick)];
+        if (Slot.Tick != Tick) { return; }
+
+        Slot.Tick = kInvalidTick;
+        --NumElements;
+    }
+}
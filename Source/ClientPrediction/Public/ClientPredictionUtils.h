@@ -6,7 +6,26 @@
 
 #include "ClientPredictionTick.h"
 
+class AClientPredictionSimProxyManager;
+
 namespace ClientPrediction {
+    /** Everything about a physics tick that is the same for every sim in a world. This is built once per tick and shared by all of the coordinators. */
+    struct FWorldTickContext {
+        Chaos::FPhysicsSolver* PhysSolver = nullptr;
+        AClientPredictionSimProxyManager* SimProxyWorldManager = nullptr;
+
+        Chaos::FReal Dt = 0.0;
+        Chaos::FReal SolverTime = 0.0;
+        bool bIsResim = false;
+
+        /** Only valid on clients once the player controller has been assigned a network physics tick offset. */
+        bool bHasNetworkPhysicsTickOffset = false;
+        int32 NetworkPhysicsTickOffset = 0;
+
+        /** Added to the server tick of autonomous proxies, so that the client can change how far ahead of the authority its inputs arrive. */
+        int32 InputLeadOffset = 0;
+    };
+
     struct FUtils {
     private:
         FUtils() = default;
@@ -31,21 +50,40 @@ namespace ClientPrediction {
             return PhysScene->GetSolver();
         }
 
-        static inline bool FillTickInfo(FTickInfo& Info, int32 LocalTick, ENetRole Role, const UWorld* World) {
+        static inline bool FillWorldTickContext(FWorldTickContext& Context, const UWorld* World) {
             Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver(World);
             if (PhysSolver == nullptr) { return false; }
 
-            Info.Dt = PhysSolver->GetAsyncDeltaTime();
-            Info.bIsResim = PhysSolver->GetEvolution()->IsResimming();
+            Context.PhysSolver = PhysSolver;
+            Context.Dt = PhysSolver->GetAsyncDeltaTime();
+            Context.SolverTime = PhysSolver->GetSolverTime();
+            Context.bIsResim = PhysSolver->GetEvolution()->IsResimming();
+
+            const APlayerController* PlayerController = GetPlayerController(World);
+            Context.bHasNetworkPhysicsTickOffset = PlayerController != nullptr && PlayerController->GetNetworkPhysicsTickOffsetAssigned();
+            Context.NetworkPhysicsTickOffset = Context.bHasNetworkPhysicsTickOffset ? PlayerController->GetNetworkPhysicsTickOffset() : 0;
+
+            return true;
+        }
+
+        static inline bool FillTickInfo(FTickInfo& Info, int32 LocalTick, ENetRole Role, const UWorld* World) {
+            FWorldTickContext Context{};
+            if (!FillWorldTickContext(Context, World)) { return false; }
+
+            return FillTickInfo(Info, LocalTick, Role, Context);
+        }
+
+        static inline bool FillTickInfo(FTickInfo& Info, int32 LocalTick, ENetRole Role, const FWorldTickContext& Context) {
+            Info.Dt = Context.Dt;
+            Info.bIsResim = Context.bIsResim;
 
             if (Role != ENetRole::ROLE_Authority) {
-                APlayerController* PlayerController = GetPlayerController(World);
-                if (PlayerController == nullptr || !PlayerController->GetNetworkPhysicsTickOffsetAssigned()) {
+                if (!Context.bHasNetworkPhysicsTickOffset) {
                     return false;
                 }
 
                 Info.LocalTick = LocalTick;
-                Info.ServerTick = LocalTick + PlayerController->GetNetworkPhysicsTickOffset();
+                Info.ServerTick = LocalTick + Context.NetworkPhysicsTickOffset + (Role == ENetRole::ROLE_AutonomousProxy ? Context.InputLeadOffset : 0);
             }
             else {
                 Info.LocalTick = LocalTick;
@@ -27,11 +27,30 @@ public:
 private:
     void DestroySimulation();
 
+    // The sim proxy manager sends the inputs and the remote sim proxy offset of every sim on the client through one of them. Events for every sim are
+    // received by the connection manager.
+    friend class AClientPredictionSimProxyManager;
+    friend class AClientPredictionConnectionManager;
+
     UFUNCTION(Server, Unreliable)
-    void ServerRecvInput(const FBundledPackets& Bundle);
+    void ServerRecvInputs(const TArray<FAggregatedBundle>& Bundles);
+
+    /** The number of inputs the authority wants the owning client to send in every bundle, based on how many of its bundles are lost. */
+    UPROPERTY(ReplicatedUsing=OnRep_InputWindowSize, Transient)
+    uint8 InputWindowSize = 0;
+
+    UFUNCTION()
+    void OnRep_InputWindowSize();
+
+    /** Tells the owning client to move its ticks ahead or back, so that the authority has just enough of its input buffered. */
+    UPROPERTY(ReplicatedUsing=OnRep_InputLeadAdjustment, Transient)
+    FInputLeadAdjustment InputLeadAdjustment;
+
+    UFUNCTION()
+    void OnRep_InputLeadAdjustment();
 
     UPROPERTY(ReplicatedUsing=OnRep_SimProxyStates, Transient)
-    FBundledPacketsLow SimProxyStates;
+    FBundledPacketsDelta SimProxyStates;
 
     UPROPERTY(ReplicatedUsing=OnRep_AutoProxyStates, Transient)
     FBundledPacketsFull AutoProxyStates;
@@ -48,9 +67,6 @@ private:
     UFUNCTION()
     void OnRep_FinalState();
 
-    UFUNCTION(NetMulticast, Reliable)
-    void ClientRecvEvents(const FBundledPackets& Bundle);
-
     UFUNCTION(Server, Reliable)
     void ServerRecvRemoteSimProxyOffset(const FRemoteSimProxyOffset& Offset);
 
@@ -76,19 +92,30 @@ TSharedPtr<ClientPrediction::FSimDelegates<Traits>> UClientPredictionV2Component
 
     InputImpl->EmitInputBundleDelegate.BindWeakLambda(this, [&](const FBundledPackets& Bundle) {
         if (!ShouldSendToServer()) { return; }
-        ServerRecvInput(Bundle);
+
+        if (AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld())) {
+            Manager->QueueInputBundle(this, Bundle);
+        }
     });
 
+    InputImpl->EmitInputWindowSizeDelegate.BindLambda([&](uint8 WindowSize) { InputWindowSize = WindowSize; });
+    InputImpl->EmitInputLeadAdjustmentDelegate.BindLambda([&](const FInputLeadAdjustment& Adjustment) { InputLeadAdjustment = Adjustment; });
 
-    StateImpl->EmitSimProxyBundle.BindLambda([&](const FBundledPacketsLow& Packets) { SimProxyStates.Bundle().Copy(Packets.Bundle()); });
+
+    StateImpl->EmitSimProxyBundle.BindLambda([&](const FBundledPacketsDelta& Packets) { SimProxyStates.Copy(Packets); });
     StateImpl->EmitAutoProxyBundle.BindLambda([&](const FBundledPacketsFull& Packets) { AutoProxyStates.Bundle().Copy(Packets.Bundle()); });
     StateImpl->EmitFinalBundle.BindLambda([&](const FBundledPacketsFull& Packets) { FinalState.Bundle().Copy(Packets.Bundle()); });
 
-    SimEvents->EmitEventBundle.BindUFunction(this, TEXT("ClientRecvEvents"));
+    SimEvents->EmitEventBundle.BindWeakLambda(this, [&](const FBundledPackets& Bundle) {
+        if (AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld())) {
+            Manager->QueueEventBundle(this, Bundle);
+        }
+    });
 
-    Impl->RemoteSimProxyOffsetChangedDelegate.BindWeakLambda(this, [&](const FRemoteSimProxyOffset& Offset) {
-        if (!ShouldSendToServer()) { return; }
-        ServerRecvRemoteSimProxyOffset(Offset);
+    SimEvents->EmitUnreliableEventBundle.BindWeakLambda(this, [&](const FBundledPackets& Bundle) {
+        if (AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld())) {
+            Manager->QueueUnreliableEventBundle(this, Bundle);
+        }
     });
 
     SimInput = MoveTemp(InputImpl);